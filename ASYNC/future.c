@@ -5,6 +5,8 @@
  */
 
 #include <stdio.h>
+#include <errno.h>
+#include <time.h>
 #include "future.h"
 
 /** @brief function_wrapper Provide wrapper for function that can be used
@@ -24,8 +26,13 @@ typedef struct callback{
                                                     Initiated only in callback created by map. */
 } callback_t;
 
+/** @brief current_future Future whose task is executed by the thread.
+ */
+static __thread future_t *current_future = NULL;
+
 /** @brief execute_map_call Defer single callback to threadpool.
  * Using to defer callbacks from map when result was calculated.
+ * Callback is deferred with high priority, because somebody may await it.
  * @param map_call[in, out]   - pointer to callback.
  */
 void execute_map_call(callback_t *map_call){
@@ -34,7 +41,7 @@ void execute_map_call(callback_t *map_call){
     runnable.arg = map_call;
     runnable.argsz = sizeof(map_call);
 
-    if (defer(map_call->pool, runnable) != 0){
+    if (defer_priority(map_call->pool, runnable, PRIORITY_HIGH) != 0){
         fprintf(stderr, "can't defer map_call\n");
     }
 }
@@ -64,31 +71,70 @@ void execute_map_calls (future_t *future){
 
 /** @brief function_wrapper Provide wrapper for function that can be used in runnable_t.
  * Function executes given function, save result and execute map calls.
+ * Task of cancelled future is dropped without executing function.
  * Works only if args is pointer to callback.
  * @param args[in,out]   - pointer to callback.
  */
 void function_wrapper(void *args, size_t argsz __attribute__((unused))){
     callback_t *callback = (callback_t*)args;
+    future_t *future = callback->future;
     void *result;
 
+    if (future_cancelled(future)){
+        free(args);
+        return;
+    }
+
+    current_future = future;
     result = (*(callback->function))
-            (callback->function_arg, callback->function_argsz, &callback->future->ret_size);
-    mutex_lock(&callback->future->mutex);
+            (callback->function_arg, callback->function_argsz, &future->ret_size);
+    current_future = NULL;
+    mutex_lock(&future->mutex);
+
+    // Result of future cancelled during calculation is never published,
+    // but it's stored to let user release it.
+    future->value = result;
+    if (future->cancelled){
+        mutex_unlock(&future->mutex);
+        free(args);
+        return;
+    }
 
-    // Setting result and marking future as resolved.
-    callback->future->value = result;
-    callback->future->resolved = 1;
+    // Marking future as resolved.
+    future->resolved = 1;
 
     // Notifying that result was calculated.
-    condition_broadcast(&callback->future->result);
+    condition_broadcast(&future->result);
 
     // Execute map_calls.
-    execute_map_calls(callback->future);
+    execute_map_calls(future);
 
-    mutex_unlock(&callback->future->mutex);
+    mutex_unlock(&future->mutex);
     free(args);
 }
 
+/** @brief cancel_locked Cancels future and futures mapped from it.
+ * Assumes that thread using this function owns future's mutex.
+ * @param future[in, out]   - pointer to future.
+ */
+void cancel_locked(future_t *future){
+    callback_t *callback;
+    if (future->cancelled)
+        return;
+    __atomic_store_n(&future->cancelled, 1, __ATOMIC_RELEASE);
+    // Marking that result can't be calculated and waking up waiting threads.
+    future->resolved = -1;
+    condition_broadcast(&future->result);
+
+    // Propagating cancellation to map calls, which won't be deferred.
+    while ((callback = (callback_t*)pop_queue(future->map_calls)) != NULL){
+        mutex_lock(&callback->future->mutex);
+        cancel_locked(callback->future);
+        mutex_unlock(&callback->future->mutex);
+        free(callback);
+    }
+}
+
 /** @brief future_init Initiating given future.
  * @param future[in, out]   - pointer to future.
  * @return Value @p 0 if initiating succeed, otherwise value @p -1.
@@ -97,6 +143,7 @@ int future_init(future_t *future){
     if (future == NULL)
         return -1;
     future->initiated = 0;
+    future->cancelled = 0;
     future->resolved = -1;
     future->value = NULL;
     future->ret_size = 0;
@@ -110,11 +157,17 @@ int future_init(future_t *future){
         return -1;
     }
 
-    if (pthread_cond_init(&future->result, NULL) != 0){
+    // Condition uses monotonic clock to measure await_for timeouts.
+    pthread_condattr_t attr;
+    if (pthread_condattr_init(&attr) != 0
+        || pthread_condattr_setclock(&attr, CLOCK_MONOTONIC) != 0
+        || pthread_cond_init(&future->result, &attr) != 0){
+        pthread_condattr_destroy(&attr);
         delete_queue(future->map_calls);
         pthread_mutex_destroy(&future->mutex);
         return -1;
     }
+    pthread_condattr_destroy(&attr);
 
     future->initiated = 1;
     return 0;
@@ -153,7 +206,7 @@ int async(thread_pool_t *pool, future_t *future, callable_t callable) {
 
     mutex_lock(&future->mutex);
     // Marking future that result is expected.
-    if (future->resolved == -1)
+    if (future->resolved == -1 && future->cancelled == 0)
         future->resolved = 0;
     mutex_unlock(&future->mutex);
     return 0;
@@ -182,10 +235,21 @@ int map(thread_pool_t *pool, future_t *future, future_t *from,
     }
 
     mutex_lock(&from->mutex);
+    // Result of cancelled future will be never calculated, so mapped future
+    // is cancelled too.
+    if (from->cancelled){
+        mutex_lock(&future->mutex);
+        cancel_locked(future);
+        mutex_unlock(&future->mutex);
+        mutex_unlock(&from->mutex);
+        return -1;
+    }
     // Creating callback.
     callback_t *new_callback = (callback_t*)malloc(sizeof(callback_t));
-    if (new_callback == NULL)
+    if (new_callback == NULL){
+        mutex_unlock(&from->mutex);
         return -1;
+    }
     new_callback->function = function;
     new_callback->future = future;
     new_callback->pool = pool;
@@ -214,7 +278,7 @@ int map(thread_pool_t *pool, future_t *future, future_t *from,
     runnable.arg = (void*)new_callback;
     runnable.argsz = sizeof(new_callback);
 
-    if (defer(pool, runnable) != 0){
+    if (defer_priority(pool, runnable, PRIORITY_HIGH) != 0){
         free(new_callback);
         return -1;
     }
@@ -252,3 +316,81 @@ void *await(future_t *future) {
     mutex_unlock(&future->mutex);
     return result;
 }
+
+/** @brief await_for Provides result of future if it is calculated in given time.
+ * @param future[in, out]   - pointer to future;
+ * @param timeout[in]       - maximal waiting time;
+ * @param result[out]       - place to store pointer to calculated result.
+ * @return Value @p 0 if result was calculated, value @p -1 when time ran out,
+ * value @p -2 when result will be never calculated or future is not
+ * initialized.
+ */
+int await_for(future_t *future, const struct timespec *timeout, void **result) {
+    struct timespec abstime;
+    int err = 0;
+    if (future == NULL || timeout == NULL || result == NULL)
+        return -2;
+    if (future->initiated == 0)
+        return -2;
+    // Calculating moment when waiting ends.
+    clock_gettime(CLOCK_MONOTONIC, &abstime);
+    abstime.tv_sec += timeout->tv_sec;
+    abstime.tv_nsec += timeout->tv_nsec;
+    if (abstime.tv_nsec >= 1000000000L){
+        abstime.tv_sec += abstime.tv_nsec / 1000000000L;
+        abstime.tv_nsec %= 1000000000L;
+    }
+    mutex_lock(&future->mutex);
+    // Waiting for the result.
+    while (future->resolved == 0 && err != ETIMEDOUT)
+        err = condition_timedwait(&future->result, &future->mutex, &abstime);
+    if (future->resolved == 1){
+        *result = future->value;
+        mutex_unlock(&future->mutex);
+        return 0;
+    }
+    err = future->resolved == 0 ? -1 : -2;
+    mutex_unlock(&future->mutex);
+    return err;
+}
+
+/** @brief future_cancel Cancels calculating future's result.
+ * Task which hasn't started yet won't be executed. Running task is notified,
+ * it may check it with @ref cancellation_requested and finish early.
+ * Cancellation is propagated to all futures mapped from given one.
+ * Awaiting cancelled future returns NULL.
+ * @param future[in, out]   - pointer to future.
+ * @return Value @p 0 if future was cancelled, value @p -1 when result was
+ * already calculated or future is not initialized.
+ */
+int future_cancel(future_t *future) {
+    if (future == NULL || future->initiated == 0)
+        return -1;
+    mutex_lock(&future->mutex);
+    if (future->resolved == 1){
+        mutex_unlock(&future->mutex);
+        return -1;
+    }
+    cancel_locked(future);
+    mutex_unlock(&future->mutex);
+    return 0;
+}
+
+/** @brief future_cancelled Checks if future was cancelled.
+ * @param future[in]   - pointer to future.
+ * @return Value @p 1 if future was cancelled, otherwise @p 0.
+ */
+int future_cancelled(future_t *future) {
+    if (future == NULL)
+        return 0;
+    return __atomic_load_n(&future->cancelled, __ATOMIC_ACQUIRE);
+}
+
+/** @brief cancellation_requested Checks if task executed by calling thread
+ * was cancelled. Designed to be polled by long running callable's functions.
+ * @return Value @p 1 if task was cancelled, value @p 0 if it wasn't or
+ * thread doesn't execute any future's task.
+ */
+int cancellation_requested() {
+    return future_cancelled(current_future);
+}
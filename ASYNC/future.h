@@ -25,6 +25,7 @@ typedef struct future {
     int resolved;             /* Flag indicates if future is/can be/can't be
                                  resolved. */
     int initiated;            /* Flag indicates if future is initiated. */
+    int cancelled;            /* Flag indicates if future was cancelled. */
     size_t ret_size;          /* Size of result. */
     pthread_mutex_t mutex;    /* Mutex for exclusive access to variables. */
     pthread_cond_t result;    /* Signaled when result was calculated. */
@@ -58,4 +59,38 @@ int map(thread_pool_t *pool, future_t *future, future_t *from,
  */
 void *await(future_t *future);
 
+/** @brief await_for Provides result of future if it is calculated in given time.
+ * @param future[in, out]   - pointer to future;
+ * @param timeout[in]       - maximal waiting time;
+ * @param result[out]       - place to store pointer to calculated result.
+ * @return Value @p 0 if result was calculated, value @p -1 when time ran out,
+ * value @p -2 when result will be never calculated or future is not
+ * initialized.
+ */
+int await_for(future_t *future, const struct timespec *timeout, void **result);
+
+/** @brief future_cancel Cancels calculating future's result.
+ * Task which hasn't started yet won't be executed. Running task is notified,
+ * it may check it with @ref cancellation_requested and finish early.
+ * Cancellation is propagated to all futures mapped from given one.
+ * Awaiting cancelled future returns NULL.
+ * @param future[in, out]   - pointer to future.
+ * @return Value @p 0 if future was cancelled, value @p -1 when result was
+ * already calculated or future is not initialized.
+ */
+int future_cancel(future_t *future);
+
+/** @brief future_cancelled Checks if future was cancelled.
+ * @param future[in]   - pointer to future.
+ * @return Value @p 1 if future was cancelled, otherwise @p 0.
+ */
+int future_cancelled(future_t *future);
+
+/** @brief cancellation_requested Checks if task executed by calling thread
+ * was cancelled. Designed to be polled by long running callable's functions.
+ * @return Value @p 1 if task was cancelled, value @p 0 if it wasn't or
+ * thread doesn't execute any future's task.
+ */
+int cancellation_requested();
+
 #endif
@@ -0,0 +1,104 @@
+/** @file
+ * Priority queue implementation based on binary heap.
+ *
+ * @author Piotr Jasinski <jasinskipiotr99@gmail.com>
+ */
+
+#include "heap.h"
+
+/** @brief less_node Compares two heap's objects.
+ * @param a[in]   - pointer to first object;
+ * @param b[in]   - pointer to second object.
+ * @return Value @p 1 if first object should be popped earlier, otherwise @p 0.
+ */
+int less_node(heap_node_t *a, heap_node_t *b){
+    if (a->key != b->key)
+        return a->key < b->key;
+    return a->order < b->order;
+}
+
+/** @brief swap_nodes Swaps two heap's objects.
+ * @param a[in, out]   - pointer to first object;
+ * @param b[in, out]   - pointer to second object.
+ */
+void swap_nodes(heap_node_t *a, heap_node_t *b){
+    heap_node_t tmp = *a;
+    *a = *b;
+    *b = tmp;
+}
+
+/** @brief make_heap Creates empty heap.
+ * @return Pointer to the heap or NULL if allocation problem occurred.
+ */
+heap_t* make_heap(){
+    heap_t *new_heap = (heap_t*)malloc(sizeof(heap_t));
+    if (new_heap == NULL)
+        return NULL;
+    new_heap->nodes = NULL;
+    new_heap->size = 0;
+    new_heap->capacity = 0;
+    new_heap->counter = 0;
+    return new_heap;
+}
+
+/** @brief add_heap Adds element to heap.
+ * @param heap[in, out]    - pointer to heap;
+ * @param key              - key of element;
+ * @param value[in, out]   - pointer to element.
+ * @return Value @p 0 if element was added, otherwise @p -1.
+ */
+int add_heap(heap_t *heap, uint64_t key, void *value){
+    // Doubling array when it's full.
+    if (heap->size == heap->capacity){
+        size_t new_capacity = heap->capacity == 0 ? 16 : 2 * heap->capacity;
+        heap_node_t *new_nodes = (heap_node_t*)realloc(heap->nodes,
+                                              sizeof(heap_node_t) * new_capacity);
+        if (new_nodes == NULL)
+            return -1;
+        heap->nodes = new_nodes;
+        heap->capacity = new_capacity;
+    }
+    size_t pos = heap->size++;
+    heap->nodes[pos].key = key;
+    heap->nodes[pos].order = heap->counter++;
+    heap->nodes[pos].value = value;
+    // Moving new element up.
+    while (pos > 0 && less_node(&heap->nodes[pos], &heap->nodes[(pos - 1) / 2])){
+        swap_nodes(&heap->nodes[pos], &heap->nodes[(pos - 1) / 2]);
+        pos = (pos - 1) / 2;
+    }
+    return 0;
+}
+
+/** @brief pop_heap Removes object with smallest key from heap.
+ * @param heap[in, out]   - pointer to heap.
+ * @return Pointer to element or NULL if heap is empty.
+ */
+void* pop_heap(heap_t *heap){
+    void *value;
+    size_t pos = 0;
+    if (heap->size == 0)
+        return NULL;
+    value = heap->nodes[0].value;
+    heap->nodes[0] = heap->nodes[--heap->size];
+    // Moving last element down.
+    while (2 * pos + 1 < heap->size){
+        size_t child = 2 * pos + 1;
+        if (child + 1 < heap->size
+            && less_node(&heap->nodes[child + 1], &heap->nodes[child]))
+            child++;
+        if (!less_node(&heap->nodes[child], &heap->nodes[pos]))
+            break;
+        swap_nodes(&heap->nodes[child], &heap->nodes[pos]);
+        pos = child;
+    }
+    return value;
+}
+
+/** @brief delete_heap Deletes heap.
+ * @param heap[in]   - pointer to heap.
+ */
+void delete_heap(heap_t *heap){
+    free(heap->nodes);
+    free(heap);
+}
@@ -0,0 +1,57 @@
+/** @file
+ * Priority queue interface.
+ * Heap enables storing objects of any type ordered by integer key,
+ * objects with equal keys are popped in insertion order.
+ *
+ * @author Piotr Jasinski <jasinskipiotr99@gmail.com>
+ */
+
+#ifndef HEAP_H
+#define HEAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/** @brief The heap_node struct represents one object in heap.
+ */
+typedef struct heap_node {
+    uint64_t key;              /* Key of object, smallest key is on top. */
+    uint64_t order;            /* Insertion number, breaks ties between keys. */
+    void *value;               /* Pointer to object in heap. */
+} heap_node_t;
+
+/** @brief The heap struct represents binary min-heap.
+  */
+typedef struct heap {
+    heap_node_t *nodes;        /* Array of objects in heap. */
+    size_t size;               /* Number of objects in heap. */
+    size_t capacity;           /* Size of allocated array. */
+    uint64_t counter;          /* Number of objects ever added to heap. */
+} heap_t;
+
+/** @brief make_heap Creates empty heap.
+ * @return Pointer to the heap or NULL if allocation problem occurred.
+ */
+heap_t *make_heap();
+
+/** @brief add_heap Adds element to heap.
+ * @param heap[in, out]    - pointer to heap;
+ * @param key              - key of element;
+ * @param value[in, out]   - pointer to element.
+ * @return Value @p 0 if element was added, otherwise @p -1.
+ */
+int add_heap(heap_t *heap, uint64_t key, void *value);
+
+/** @brief pop_heap Removes object with smallest key from heap.
+ * @param heap[in, out]   - pointer to heap.
+ * @return Pointer to element or NULL if heap is empty.
+ */
+void *pop_heap(heap_t *heap);
+
+/** @brief delete_heap Deletes heap.
+ * @param heap[in]   - pointer to heap.
+ */
+void delete_heap(heap_t *heap);
+
+#endif
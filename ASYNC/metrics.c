@@ -0,0 +1,133 @@
+/** @file
+ * Implementation of threadpool's runtime metrics.
+ *
+ * @author Piotr Jasinski <jasinskipiotr99@gmail.com>
+ */
+
+#include <string.h>
+#include <time.h>
+#include "metrics.h"
+
+/** @brief bucket Finds histogram's bucket for given duration.
+ * @param ns   - duration in nanoseconds.
+ * @return Index of bucket.
+ */
+static size_t bucket(uint64_t ns){
+    size_t b = ns == 0 ? 0 : 64 - __builtin_clzll(ns);
+    return b < METRICS_BUCKETS ? b : METRICS_BUCKETS - 1;
+}
+
+/** @brief increase Increases counter updated only by its owner.
+ * Store is atomic, so concurrent readers never see torn value.
+ * @param counter[in, out]   - pointer to counter;
+ * @param value              - value to add.
+ */
+static void increase(uint64_t *counter, uint64_t value){
+    __atomic_store_n(counter, *counter + value, __ATOMIC_RELAXED);
+}
+
+/** @brief metrics_now Provides current time of monotonic clock.
+ * @return Time in nanoseconds.
+ */
+uint64_t metrics_now(){
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t)time.tv_sec * 1000000000ULL + (uint64_t)time.tv_nsec;
+}
+
+/** @brief metrics_clear Resets all counters.
+ * @param metrics[out]   - pointer to worker's metrics.
+ */
+void metrics_clear(worker_metrics_t *metrics){
+    memset(metrics, 0, sizeof(worker_metrics_t));
+}
+
+/** @brief metrics_task Records executed task.
+ * Only owner of metrics can use this function.
+ * @param metrics[in, out]   - pointer to worker's metrics;
+ * @param wait_ns            - time task spent in queue;
+ * @param run_ns             - time of executing task.
+ */
+void metrics_task(worker_metrics_t *metrics, uint64_t wait_ns, uint64_t run_ns){
+    increase(&metrics->tasks, 1);
+    increase(&metrics->wait_ns, wait_ns);
+    increase(&metrics->run_ns, run_ns);
+    increase(&metrics->wait_hist[bucket(wait_ns)], 1);
+    increase(&metrics->run_hist[bucket(run_ns)], 1);
+}
+
+/** @brief metrics_idle Records worker's waiting for work.
+ * Only owner of metrics can use this function.
+ * @param metrics[in, out]   - pointer to worker's metrics;
+ * @param idle_ns            - time of waiting;
+ * @param wakeups            - number of wake ups during waiting.
+ */
+void metrics_idle(worker_metrics_t *metrics, uint64_t idle_ns, uint64_t wakeups){
+    increase(&metrics->idle_ns, idle_ns);
+    increase(&metrics->wakeups, wakeups);
+}
+
+/** @brief metrics_read Copies counters which may be updated by their owner.
+ * @param metrics[in]    - pointer to worker's metrics;
+ * @param snapshot[out]  - place to store copy of counters.
+ */
+void metrics_read(const worker_metrics_t *metrics, worker_metrics_t *snapshot){
+    snapshot->tasks = __atomic_load_n(&metrics->tasks, __ATOMIC_RELAXED);
+    snapshot->wait_ns = __atomic_load_n(&metrics->wait_ns, __ATOMIC_RELAXED);
+    snapshot->run_ns = __atomic_load_n(&metrics->run_ns, __ATOMIC_RELAXED);
+    snapshot->idle_ns = __atomic_load_n(&metrics->idle_ns, __ATOMIC_RELAXED);
+    snapshot->wakeups = __atomic_load_n(&metrics->wakeups, __ATOMIC_RELAXED);
+    for (size_t i = 0; i < METRICS_BUCKETS; i++){
+        snapshot->wait_hist[i] = __atomic_load_n(&metrics->wait_hist[i],
+                                                 __ATOMIC_RELAXED);
+        snapshot->run_hist[i] = __atomic_load_n(&metrics->run_hist[i],
+                                                __ATOMIC_RELAXED);
+    }
+}
+
+/** @brief metrics_add Adds counters to accumulated ones.
+ * @param sum[in, out]   - pointer to accumulated counters;
+ * @param metrics[in]    - pointer to counters to add.
+ */
+void metrics_add(worker_metrics_t *sum, const worker_metrics_t *metrics){
+    sum->tasks += metrics->tasks;
+    sum->wait_ns += metrics->wait_ns;
+    sum->run_ns += metrics->run_ns;
+    sum->idle_ns += metrics->idle_ns;
+    sum->wakeups += metrics->wakeups;
+    for (size_t i = 0; i < METRICS_BUCKETS; i++){
+        sum->wait_hist[i] += metrics->wait_hist[i];
+        sum->run_hist[i] += metrics->run_hist[i];
+    }
+}
+
+/** @brief print_hist Prints non empty histogram's buckets.
+ * @param out[in, out]   - output stream;
+ * @param name[in]       - name of histogram;
+ * @param hist[in]       - histogram.
+ */
+static void print_hist(FILE *out, const char *name, const uint64_t *hist){
+    fprintf(out, "  %s:", name);
+    for (size_t i = 0; i < METRICS_BUCKETS; i++){
+        if (hist[i] > 0)
+            fprintf(out, " <2^%zu:%llu", i, (unsigned long long)hist[i]);
+    }
+    fprintf(out, "\n");
+}
+
+/** @brief metrics_print Prints counters in human readable form.
+ * @param out[in, out]   - output stream;
+ * @param name[in]       - name of printed counters;
+ * @param metrics[in]    - pointer to counters.
+ */
+void metrics_print(FILE *out, const char *name, const worker_metrics_t *metrics){
+    fprintf(out, "%s: tasks %llu, wait %llu ns, run %llu ns, idle %llu ns, "
+            "wakeups %llu\n", name,
+            (unsigned long long)metrics->tasks,
+            (unsigned long long)metrics->wait_ns,
+            (unsigned long long)metrics->run_ns,
+            (unsigned long long)metrics->idle_ns,
+            (unsigned long long)metrics->wakeups);
+    print_hist(out, "wait ns", metrics->wait_hist);
+    print_hist(out, "run ns", metrics->run_hist);
+}
@@ -0,0 +1,77 @@
+/** @file
+ * Threadpool's runtime metrics interface.
+ * Each worker owns its counters placed on separate cache line, so workers
+ * update them without synchronization. Counters are collected only when
+ * library is compiled with THREADPOOL_METRICS defined.
+ *
+ * @author Piotr Jasinski <jasinskipiotr99@gmail.com>
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define METRICS_BUCKETS 32
+#define METRICS_CACHE_LINE 64
+
+/** @brief The worker_metrics struct contains counters of one worker.
+ * Histograms' bucket @p i counts durations in range [2^(i-1), 2^i) ns.
+ */
+typedef struct worker_metrics {
+    uint64_t tasks;                          /* Number of executed tasks. */
+    uint64_t wait_ns;                        /* Total time tasks spent in queue. */
+    uint64_t run_ns;                         /* Total time of executing tasks. */
+    uint64_t idle_ns;                        /* Total time of waiting for work. */
+    uint64_t wakeups;                        /* Number of wake ups after waiting. */
+    uint64_t wait_hist[METRICS_BUCKETS];     /* Histogram of queue wait time. */
+    uint64_t run_hist[METRICS_BUCKETS];      /* Histogram of run time. */
+} __attribute__((aligned(METRICS_CACHE_LINE))) worker_metrics_t;
+
+/** @brief metrics_now Provides current time of monotonic clock.
+ * @return Time in nanoseconds.
+ */
+uint64_t metrics_now();
+
+/** @brief metrics_clear Resets all counters.
+ * @param metrics[out]   - pointer to worker's metrics.
+ */
+void metrics_clear(worker_metrics_t *metrics);
+
+/** @brief metrics_task Records executed task.
+ * Only owner of metrics can use this function.
+ * @param metrics[in, out]   - pointer to worker's metrics;
+ * @param wait_ns            - time task spent in queue;
+ * @param run_ns             - time of executing task.
+ */
+void metrics_task(worker_metrics_t *metrics, uint64_t wait_ns, uint64_t run_ns);
+
+/** @brief metrics_idle Records worker's waiting for work.
+ * Only owner of metrics can use this function.
+ * @param metrics[in, out]   - pointer to worker's metrics;
+ * @param idle_ns            - time of waiting;
+ * @param wakeups            - number of wake ups during waiting.
+ */
+void metrics_idle(worker_metrics_t *metrics, uint64_t idle_ns, uint64_t wakeups);
+
+/** @brief metrics_read Copies counters which may be updated by their owner.
+ * @param metrics[in]    - pointer to worker's metrics;
+ * @param snapshot[out]  - place to store copy of counters.
+ */
+void metrics_read(const worker_metrics_t *metrics, worker_metrics_t *snapshot);
+
+/** @brief metrics_add Adds counters to accumulated ones.
+ * @param sum[in, out]   - pointer to accumulated counters;
+ * @param metrics[in]    - pointer to counters to add.
+ */
+void metrics_add(worker_metrics_t *sum, const worker_metrics_t *metrics);
+
+/** @brief metrics_print Prints counters in human readable form.
+ * @param out[in, out]   - output stream;
+ * @param name[in]       - name of printed counters;
+ * @param metrics[in]    - pointer to counters.
+ */
+void metrics_print(FILE *out, const char *name, const worker_metrics_t *metrics);
+
+#endif
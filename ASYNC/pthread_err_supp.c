@@ -6,6 +6,7 @@
 
 #include "pthread_err_supp.h"
 #include "err.h"
+#include <errno.h>
 #include <signal.h>
 
 
@@ -46,6 +47,22 @@ void condition_wait(pthread_cond_t *cond, pthread_mutex_t *mutex){
     syserr(err, "condition wait error");
 }
 
+/** @brief condition_timedwait Handles waiting on condition with timeout errors.
+ * @param cond[in, out]    - pointer to condition;
+ * @param mutex[in, out]   - pointer to mutex to be released;
+ * @param abstime[in]      - absolute time when waiting ends.
+ * @return Value @p 0 if condition was signaled, value @p ETIMEDOUT if time
+ * ran out.
+ */
+int condition_timedwait(pthread_cond_t *cond, pthread_mutex_t *mutex,
+                        const struct timespec *abstime){
+  int err;
+  err = pthread_cond_timedwait(cond, mutex, abstime);
+  if (err != 0 && err != ETIMEDOUT)
+    syserr(err, "condition timedwait error");
+  return err;
+}
+
 /** @brief condition_signal Handles signal on condition errors.
  * @param cond[in, out]    - pointer to condition.
  */
@@ -32,6 +32,16 @@ void mutex_destroy(pthread_mutex_t *mutex);
  */
 void condition_wait(pthread_cond_t *cond, pthread_mutex_t *mutex);
 
+/** @brief condition_timedwait Handles waiting on condition with timeout errors.
+ * @param cond[in, out]    - pointer to condition;
+ * @param mutex[in, out]   - pointer to mutex to be released;
+ * @param abstime[in]      - absolute time when waiting ends.
+ * @return Value @p 0 if condition was signaled, value @p ETIMEDOUT if time
+ * ran out.
+ */
+int condition_timedwait(pthread_cond_t *cond, pthread_mutex_t *mutex,
+                        const struct timespec *abstime);
+
 /** @brief condition_signal Handles signal on condition errors.
  * @param cond[in, out]    - pointer to condition.
  */
@@ -12,6 +12,14 @@
 #include "err.h"
 #include "pthread_err_supp.h"
 
+/** @brief The task struct represents registered task.
+ */
+typedef struct task {
+    runnable_t runnable;      /* Task to do. */
+    uint64_t enqueued;        /* Time of registering task in ns, set only
+                                 when metrics are collected. */
+} task_t;
+
 /** @brief catch Handles SIGINT and SIGRTMIN.
  * Handler is used by threads working in active threadpool.
  * Assumes that first SIGRTMIN signal provides information
@@ -40,13 +48,110 @@ void catch (int sig, siginfo_t *siginfo, void *more __attribute__((unused))){
     }
 }
 
+/** @brief print_metrics Prints snapshots of all pool's workers' counters.
+ * @param out[in, out]       - output stream;
+ * @param snapshots[in]      - counters of workers;
+ * @param count[in]          - number of workers.
+ */
+void print_metrics(FILE *out, const worker_metrics_t *snapshots, size_t count){
+    worker_metrics_t sum;
+    char name[32];
+    metrics_clear(&sum);
+    for (size_t i = 0; i < count; i++){
+        metrics_add(&sum, &snapshots[i]);
+        snprintf(name, sizeof(name), "worker %zu", i);
+        metrics_print(out, name, &snapshots[i]);
+    }
+    metrics_print(out, "pool", &sum);
+    fflush(out);
+}
+
+/** @brief dump_due_metrics Prints pool's counters if it's time for dump.
+ * Counters are copied under pool's mutex and printed after releasing it,
+ * so slow stream doesn't stall other workers.
+ * Assumes that thread using this function owns pool's mutex, the mutex is
+ * owned again on return.
+ * @param pool[in, out]   - pointer to threadpool.
+ */
+void dump_due_metrics(thread_pool_t *pool){
+    if (pool->dump_file == NULL)
+        return;
+    uint64_t now = metrics_now();
+    if (now < pool->next_dump)
+        return;
+    pool->next_dump = now + pool->dump_period;
+    size_t count = pool->pool_size;
+    worker_metrics_t *snapshots = malloc(sizeof(worker_metrics_t) * count);
+    // Skipping this dump, the next one may succeed.
+    if (snapshots == NULL)
+        return;
+    for (size_t i = 0; i < count; i++)
+        metrics_read(&pool->metrics[i], &snapshots[i]);
+    FILE *out = pool->dump_file;
+    mutex_unlock(&pool->mutex);
+    print_metrics(out, snapshots, count);
+    free(snapshots);
+    mutex_lock(&pool->mutex);
+}
+
+/** @brief wait_for_work Waits until there's work to do or pool shuts down.
+ * Assumes that thread using this function owns pool's mutex.
+ * @param pool[in, out]      - pointer to thread's threadpool;
+ * @param metrics[in, out]   - pointer to thread's counters.
+ */
+void wait_for_work(thread_pool_t *pool,
+                   worker_metrics_t *metrics __attribute__((unused))){
+#ifdef THREADPOOL_METRICS
+    dump_due_metrics(pool);
+    if (pool->waiting_tasks > 0 || pool->shutdown != 0)
+        return;
+    uint64_t start = metrics_now();
+    uint64_t now;
+    while (pool->waiting_tasks == 0 && pool->shutdown == 0){
+        if (pool->dump_file != NULL){
+            // Waking up when next dump is due.
+            struct timespec abstime;
+            abstime.tv_sec = pool->next_dump / 1000000000ULL;
+            abstime.tv_nsec = pool->next_dump % 1000000000ULL;
+            condition_timedwait(&pool->work, &pool->mutex, &abstime);
+        } else {
+            condition_wait(&pool->work, &pool->mutex);
+        }
+        // Recording idle time on each wake up to make it visible in dumps.
+        now = metrics_now();
+        metrics_idle(metrics, now - start, 1);
+        start = now;
+        dump_due_metrics(pool);
+    }
+#else
+    while (pool->waiting_tasks == 0 && pool->shutdown == 0){
+        condition_wait(&pool->work, &pool->mutex);
+    }
+#endif
+}
+
 /** @brief get_work Gets task to do.
+ * Tasks are taken from high priority level, then tasks with deadline,
+ * then normal and low priority levels.
  * Assumes that thread using this function owns pool's mutex.
  * @param pool[in, out]   - pointer to thread's threadpool.
  * @return Pointer to the task.
  */
-runnable_t* get_work(thread_pool_t *pool){
-    runnable_t* task = (runnable_t*)pop_queue(pool->tasks);
+task_t* get_work(thread_pool_t *pool){
+    task_t* task = NULL;
+    if (pool->waiting_per_level[PRIORITY_HIGH] > 0){
+        task = (task_t*)pop_queue(pool->tasks[PRIORITY_HIGH]);
+        pool->waiting_per_level[PRIORITY_HIGH]--;
+    } else if (pool->deadline_tasks->size > 0){
+        task = (task_t*)pop_heap(pool->deadline_tasks);
+    } else {
+        for (int i = PRIORITY_NORMAL; i < PRIORITY_LEVELS && task == NULL; i++){
+            if (pool->waiting_per_level[i] > 0){
+                task = (task_t*)pop_queue(pool->tasks[i]);
+                pool->waiting_per_level[i]--;
+            }
+        }
+    }
     if (task == NULL)
         return NULL;
     pool->waiting_tasks--;
@@ -61,7 +166,8 @@ runnable_t* get_work(thread_pool_t *pool){
 void *thread (void *data){
     thread_pool_t *pool = (thread_pool_t*)data;
     runnable_t task;
-    runnable_t *task_pointer;
+    task_t *task_pointer;
+    worker_metrics_t *metrics;
 
     struct sigaction action;
     sigset_t block_mask;
@@ -80,12 +186,15 @@ void *thread (void *data){
     // Providing handler for SIGINT
     sigaction_create(SIGINT, &action, NULL);
 
+    // Taking thread's counters.
+    mutex_lock(&pool->mutex);
+    metrics = &pool->metrics[pool->started_threads++];
+    mutex_unlock(&pool->mutex);
+
     while(1){
         // Taking task if pool isn't shutting down.
         mutex_lock(&pool->mutex);
-        while (pool->waiting_tasks == 0 && pool->shutdown == 0){
-            condition_wait(&pool->work, &pool->mutex);
-        }
+        wait_for_work(pool, metrics);
         // If pool is shutting down and no more tasks are left thread finishes work.
         if (pool->shutdown == 1 && pool->waiting_tasks == 0)
             break;
@@ -96,8 +205,15 @@ void *thread (void *data){
             fprintf(stderr, "thread taking task from empty queue\n");
         } else {
             // Execute work.
-            task = *task_pointer;
+            task = task_pointer->runnable;
+#ifdef THREADPOOL_METRICS
+            uint64_t start = metrics_now();
+            (*(task.function))(task.arg, task.argsz);
+            metrics_task(metrics, start - task_pointer->enqueued,
+                         metrics_now() - start);
+#else
             (*(task.function))(task.arg, task.argsz);
+#endif
         }
         free(task_pointer);
     }
@@ -131,10 +247,26 @@ int thread_pool_init(thread_pool_t *pool, size_t num_threads) {
     pool->pool_size = num_threads;
     pool->waiting_tasks = 0;
     pool->shutdown = 0;
-    pool->tasks = make_queue();
+    for (int i = 0; i < PRIORITY_LEVELS; i++){
+        pool->tasks[i] = make_queue();
+        pool->waiting_per_level[i] = 0;
+        if (pool->tasks[i] == NULL)
+            return -1;
+    }
+    pool->deadline_tasks = make_heap();
     pool->threads = (pthread_t*)malloc(sizeof(pthread_t) * num_threads);
+    pool->started_threads = 0;
+    pool->dump_file = NULL;
+    pool->dump_period = 0;
+    pool->next_dump = 0;
+    // Each worker's counters are placed on separate cache line.
+    if (posix_memalign((void**)&pool->metrics, METRICS_CACHE_LINE,
+                       sizeof(worker_metrics_t) * num_threads) != 0)
+        return -1;
+    for (size_t i = 0; i < num_threads; i++)
+        metrics_clear(&pool->metrics[i]);
 
-    if (pool->tasks == NULL)
+    if (pool->deadline_tasks == NULL)
         return -1;
     if (pool->threads == NULL)
         return -1;
@@ -142,8 +274,16 @@ int thread_pool_init(thread_pool_t *pool, size_t num_threads) {
     // Initiating mutex for variables.
     if (pthread_mutex_init(&pool->mutex, NULL) != 0)
         return -1;
-    if (pthread_cond_init(&pool->work, NULL) != 0)
+    // Condition uses monotonic clock to measure time of metrics dump.
+    pthread_condattr_t attr;
+    if (pthread_condattr_init(&attr) != 0)
+        return -1;
+    if (pthread_condattr_setclock(&attr, CLOCK_MONOTONIC) != 0
+        || pthread_cond_init(&pool->work, &attr) != 0){
+        pthread_condattr_destroy(&attr);
         return -1;
+    }
+    pthread_condattr_destroy(&attr);
     for (size_t i = 0; i < pool->pool_size; i++)
         create_threads(pool, i);
     mutex_lock(&pool->mutex);
@@ -183,7 +323,10 @@ void thread_pool_destroy(thread_pool_t *pool) {
     pool->initiated = 0;
     mutex_unlock(&pool->mutex);
     free(pool->threads);
-    delete_queue(pool->tasks);
+    free(pool->metrics);
+    for (int i = 0; i < PRIORITY_LEVELS; i++)
+        delete_queue(pool->tasks[i]);
+    delete_heap(pool->deadline_tasks);
     mutex_destroy(&pool->mutex);
     condition_destroy(&pool->work);
     // Terminating process if needed.
@@ -191,19 +334,28 @@ void thread_pool_destroy(thread_pool_t *pool) {
         exit(130);
 }
 
-/** @brief defer Registers task to do.
- * Task can be only registered in initiated not shutdowning pool.
- * @param pool[in, out]   - pointer to threadpool
- * @param runnable[in]    - task to do.
+/** @brief register_task Adds copy of task to pool's queues.
+ * If @p deadline is NULL task is added to queue of given priority level,
+ * otherwise it is added to deadline ordered tasks.
+ * @param pool[in, out]   - pointer to threadpool;
+ * @param runnable[in]    - task to do;
+ * @param priority        - priority level of task;
+ * @param deadline[in]    - absolute deadline of task or NULL.
  * @return Value @p 0 if task was registered, otherwise returns @p -1.
  */
-int defer(struct thread_pool *pool, runnable_t runnable) {
-    runnable_t *runnable_copy;
+int register_task(thread_pool_t *pool, runnable_t runnable,
+                  task_priority_t priority, const struct timespec *deadline){
+    task_t *runnable_copy;
+    int err;
 
     if (pool == NULL || pool->initiated == 0){
         fprintf(stderr, "given threadpool doesn't exist or is uninitiated\n");
         return -1;
     }
+    if (priority < PRIORITY_HIGH || priority >= PRIORITY_LEVELS){
+        fprintf(stderr, "invalid task priority\n");
+        return -1;
+    }
     // If pool shuts down, new task can't be added.
     mutex_lock(&pool->mutex);
     if (pool->shutdown > 0) {
@@ -212,24 +364,187 @@ int defer(struct thread_pool *pool, runnable_t runnable) {
         return -1;
     }
 
-    runnable_copy = (runnable_t*)malloc(sizeof(runnable_t));
+    runnable_copy = (task_t*)malloc(sizeof(task_t));
     if (runnable_copy == NULL){
+        mutex_unlock(&pool->mutex);
         fprintf(stderr, "adding task error\n");
         return -1;
     }
-    runnable_copy->function = runnable.function;
-    runnable_copy->arg = runnable.arg;
-    runnable_copy->argsz = runnable.argsz;
+    runnable_copy->runnable.function = runnable.function;
+    runnable_copy->runnable.arg = runnable.arg;
+    runnable_copy->runnable.argsz = runnable.argsz;
+#ifdef THREADPOOL_METRICS
+    runnable_copy->enqueued = metrics_now();
+#else
+    runnable_copy->enqueued = 0;
+#endif
 
+    if (deadline == NULL) {
+        err = add_queue(pool->tasks[priority], (void*)runnable_copy);
+    } else {
+        uint64_t key = (uint64_t)deadline->tv_sec * 1000000000ULL
+                       + (uint64_t)deadline->tv_nsec;
+        err = add_heap(pool->deadline_tasks, key, (void*)runnable_copy);
+    }
     // If task doesn't added to queue, it isn't registered.
-    if (add_queue(pool->tasks, (void*)runnable_copy) == -1){
+    if (err == -1){
         mutex_unlock(&pool->mutex);
+        free(runnable_copy);
         fprintf(stderr, "adding task error\n");
         return -1;
     }
+    if (deadline == NULL)
+        pool->waiting_per_level[priority]++;
     pool->waiting_tasks++;
     // Signals threads that there's work to do.
     condition_signal(&pool->work);
     mutex_unlock(&pool->mutex);
     return 0;
 }
+
+/** @brief defer Registers task to do.
+ * Task is registered with normal priority.
+ * Task can be only registered in initiated not shutdowning pool.
+ * @param pool[in, out]   - pointer to threadpool
+ * @param runnable[in]    - task to do.
+ * @return Value @p 0 if task was registered, otherwise returns @p -1.
+ */
+int defer(struct thread_pool *pool, runnable_t runnable) {
+    return register_task(pool, runnable, PRIORITY_NORMAL, NULL);
+}
+
+/** @brief defer_priority Registers task to do with given priority.
+ * Task can be only registered in initiated not shutdowning pool.
+ * @param pool[in, out]   - pointer to threadpool;
+ * @param runnable[in]    - task to do;
+ * @param priority        - priority level of task.
+ * @return Value @p 0 if task was registered, otherwise returns @p -1.
+ */
+int defer_priority(thread_pool_t *pool, runnable_t runnable,
+                   task_priority_t priority) {
+    return register_task(pool, runnable, priority, NULL);
+}
+
+/** @brief defer_deadline Registers task to do before given deadline.
+ * Tasks with deadline are executed in earliest deadline first order,
+ * after high priority tasks and before normal priority ones.
+ * Task can be only registered in initiated not shutdowning pool.
+ * @param pool[in, out]   - pointer to threadpool;
+ * @param runnable[in]    - task to do;
+ * @param deadline[in]    - absolute deadline measured by CLOCK_MONOTONIC.
+ * @return Value @p 0 if task was registered, otherwise returns @p -1.
+ */
+int defer_deadline(thread_pool_t *pool, runnable_t runnable,
+                   const struct timespec *deadline) {
+    if (deadline == NULL){
+        fprintf(stderr, "missing task deadline\n");
+        return -1;
+    }
+    return register_task(pool, runnable, PRIORITY_NORMAL, deadline);
+}
+
+/** @brief queue_depth Provides number of tasks waiting on priority level.
+ * @param pool[in, out]   - pointer to threadpool;
+ * @param priority        - priority level.
+ * @return Number of waiting tasks with given priority.
+ */
+size_t queue_depth(thread_pool_t *pool, task_priority_t priority) {
+    size_t depth;
+    if (pool == NULL || pool->initiated == 0)
+        return 0;
+    if (priority < PRIORITY_HIGH || priority >= PRIORITY_LEVELS)
+        return 0;
+    mutex_lock(&pool->mutex);
+    depth = pool->waiting_per_level[priority];
+    mutex_unlock(&pool->mutex);
+    return depth;
+}
+
+/** @brief deadline_queue_depth Provides number of waiting tasks with deadline.
+ * @param pool[in, out]   - pointer to threadpool.
+ * @return Number of waiting tasks with deadline.
+ */
+size_t deadline_queue_depth(thread_pool_t *pool) {
+    size_t depth;
+    if (pool == NULL || pool->initiated == 0)
+        return 0;
+    mutex_lock(&pool->mutex);
+    depth = pool->deadline_tasks->size;
+    mutex_unlock(&pool->mutex);
+    return depth;
+}
+
+/** @brief thread_pool_worker_metrics Provides snapshot of worker's counters.
+ * Counters are collected only if library is compiled with THREADPOOL_METRICS.
+ * @param pool[in, out]   - pointer to threadpool;
+ * @param worker          - index of worker, less than pool's size;
+ * @param metrics[out]    - place to store counters.
+ * @return Value @p 0 if snapshot was taken, otherwise returns @p -1.
+ */
+int thread_pool_worker_metrics(thread_pool_t *pool, size_t worker,
+                               worker_metrics_t *metrics) {
+#ifdef THREADPOOL_METRICS
+    if (pool == NULL || pool->initiated == 0 || metrics == NULL)
+        return -1;
+    if (worker >= pool->pool_size)
+        return -1;
+    metrics_read(&pool->metrics[worker], metrics);
+    return 0;
+#else
+    (void)pool;
+    (void)worker;
+    (void)metrics;
+    return -1;
+#endif
+}
+
+/** @brief thread_pool_metrics Provides snapshot of counters summed over
+ * all pool's workers.
+ * Counters are collected only if library is compiled with THREADPOOL_METRICS.
+ * @param pool[in, out]   - pointer to threadpool;
+ * @param metrics[out]    - place to store counters.
+ * @return Value @p 0 if snapshot was taken, otherwise returns @p -1.
+ */
+int thread_pool_metrics(thread_pool_t *pool, worker_metrics_t *metrics) {
+    worker_metrics_t snapshot;
+    if (metrics == NULL)
+        return -1;
+    metrics_clear(metrics);
+    for (size_t i = 0; pool != NULL && i < pool->pool_size; i++){
+        if (thread_pool_worker_metrics(pool, i, &snapshot) != 0)
+            return -1;
+        metrics_add(metrics, &snapshot);
+    }
+    return pool == NULL ? -1 : 0;
+}
+
+/** @brief thread_pool_metrics_dump Sets periodic dump of pool's counters.
+ * Dump is written by one of pool's workers, so no extra thread is created.
+ * Dump in progress may still write to previous stream after it's replaced.
+ * @param pool[in, out]   - pointer to threadpool;
+ * @param out[in, out]    - output stream or NULL to disable dumping;
+ * @param period_ms       - period of dump in milliseconds, must be positive
+ *                          unless dumping is disabled.
+ * @return Value @p 0 if dump was set, otherwise returns @p -1.
+ */
+int thread_pool_metrics_dump(thread_pool_t *pool, FILE *out, uint64_t period_ms) {
+#ifdef THREADPOOL_METRICS
+    // Zero period would make idle workers spin instead of sleeping.
+    if (pool == NULL || pool->initiated == 0 ||
+        (out != NULL && period_ms == 0))
+        return -1;
+    mutex_lock(&pool->mutex);
+    pool->dump_file = out;
+    pool->dump_period = period_ms * 1000000ULL;
+    pool->next_dump = metrics_now() + pool->dump_period;
+    // Waking up sleeping threads to let them wait for dump time.
+    condition_broadcast(&pool->work);
+    mutex_unlock(&pool->mutex);
+    return 0;
+#else
+    (void)pool;
+    (void)out;
+    (void)period_ms;
+    return -1;
+#endif
+}
@@ -10,8 +10,11 @@
 #define THREADPOOL_H
 
 #include <stddef.h>
+#include <time.h>
 #include <pthread.h>
 #include "err.h"
+#include "heap.h"
+#include "metrics.h"
 #include "queue.h"
 #include "pthread_err_supp.h"
 
@@ -23,6 +26,19 @@ typedef struct runnable {
   size_t argsz;
 } runnable_t;
 
+/** @brief The task_priority enum represents priority levels of deferred tasks.
+ * Tasks are taken from high priority level first, then tasks with deadline
+ * (earliest deadline first), then normal and low priority levels.
+ * Tasks within one priority level are executed in FIFO order.
+ */
+typedef enum task_priority {
+    PRIORITY_HIGH = 0,
+    PRIORITY_NORMAL = 1,
+    PRIORITY_LOW = 2
+} task_priority_t;
+
+#define PRIORITY_LEVELS 3
+
 /** @brief The thread_pool struct is object representing threadpool.
   */
 typedef struct thread_pool {
@@ -33,7 +49,16 @@ typedef struct thread_pool {
     pthread_t *threads;            /* Array of created threads. */
     pthread_mutex_t mutex;         /* Mutex for exclusive access to variables. */
     pthread_cond_t work;           /* Signaled when there is work to do. */
-    queue_t *tasks;                /* Queue of tasks to be done. */
+    queue_t *tasks[PRIORITY_LEVELS]; /* Queues of tasks to be done, one per
+                                        priority level. */
+    size_t waiting_per_level[PRIORITY_LEVELS]; /* Number of waiting tasks
+                                                  per priority level. */
+    heap_t *deadline_tasks;        /* Tasks to be done ordered by deadline. */
+    size_t started_threads;        /* Number of threads which got their index. */
+    worker_metrics_t *metrics;     /* Array of workers' counters. */
+    FILE *dump_file;               /* Stream for periodic metrics dump or NULL. */
+    uint64_t dump_period;          /* Period of metrics dump in ns. */
+    uint64_t next_dump;            /* Time of next metrics dump in ns. */
     int shutdown;                  /* Flag indicates if threadpool is shutting down. */
 } thread_pool_t;
 
@@ -62,4 +87,69 @@ void thread_pool_destroy(thread_pool_t *pool);
  */
 int defer(thread_pool_t *pool, runnable_t runnable);
 
+/** @brief defer_priority Registers task to do with given priority.
+ * Task can be only registered in initiated not shutdowning pool.
+ * @param pool[in, out]   - pointer to threadpool;
+ * @param runnable[in]    - task to do;
+ * @param priority        - priority level of task.
+ * @return Value @p 0 if task was registered, otherwise returns @p -1.
+ */
+int defer_priority(thread_pool_t *pool, runnable_t runnable,
+                   task_priority_t priority);
+
+/** @brief defer_deadline Registers task to do before given deadline.
+ * Tasks with deadline are executed in earliest deadline first order,
+ * after high priority tasks and before normal priority ones.
+ * Task can be only registered in initiated not shutdowning pool.
+ * @param pool[in, out]   - pointer to threadpool;
+ * @param runnable[in]    - task to do;
+ * @param deadline[in]    - absolute deadline measured by CLOCK_MONOTONIC.
+ * @return Value @p 0 if task was registered, otherwise returns @p -1.
+ */
+int defer_deadline(thread_pool_t *pool, runnable_t runnable,
+                   const struct timespec *deadline);
+
+/** @brief queue_depth Provides number of tasks waiting on priority level.
+ * @param pool[in, out]   - pointer to threadpool;
+ * @param priority        - priority level.
+ * @return Number of waiting tasks with given priority.
+ */
+size_t queue_depth(thread_pool_t *pool, task_priority_t priority);
+
+/** @brief deadline_queue_depth Provides number of waiting tasks with deadline.
+ * @param pool[in, out]   - pointer to threadpool.
+ * @return Number of waiting tasks with deadline.
+ */
+size_t deadline_queue_depth(thread_pool_t *pool);
+
+/** @brief thread_pool_worker_metrics Provides snapshot of worker's counters.
+ * Counters are collected only if library is compiled with THREADPOOL_METRICS.
+ * @param pool[in, out]   - pointer to threadpool;
+ * @param worker          - index of worker, less than pool's size;
+ * @param metrics[out]    - place to store counters.
+ * @return Value @p 0 if snapshot was taken, otherwise returns @p -1.
+ */
+int thread_pool_worker_metrics(thread_pool_t *pool, size_t worker,
+                               worker_metrics_t *metrics);
+
+/** @brief thread_pool_metrics Provides snapshot of counters summed over
+ * all pool's workers.
+ * Counters are collected only if library is compiled with THREADPOOL_METRICS.
+ * @param pool[in, out]   - pointer to threadpool;
+ * @param metrics[out]    - place to store counters.
+ * @return Value @p 0 if snapshot was taken, otherwise returns @p -1.
+ */
+int thread_pool_metrics(thread_pool_t *pool, worker_metrics_t *metrics);
+
+/** @brief thread_pool_metrics_dump Sets periodic dump of pool's counters.
+ * Dump is written by one of pool's workers, so no extra thread is created.
+ * Dump in progress may still write to previous stream after it's replaced.
+ * @param pool[in, out]   - pointer to threadpool;
+ * @param out[in, out]    - output stream or NULL to disable dumping;
+ * @param period_ms       - period of dump in milliseconds, must be positive
+ *                          unless dumping is disabled.
+ * @return Value @p 0 if dump was set, otherwise returns @p -1.
+ */
+int thread_pool_metrics_dump(thread_pool_t *pool, FILE *out, uint64_t period_ms);
+
 #endif
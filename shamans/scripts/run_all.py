@@ -11,6 +11,7 @@ TESTS = {
     "bottomlessBagTest": [],
     "sandArrangementTest": [],
     "crystalSelectionTest": [],
+    "enginesTest": [],
     "bottomlessBagTest 1": [],
     "sandArrangementTest 1": [],
     "crystalSelectionTest 1": [],
@@ -4,22 +4,221 @@
 #include <algorithm>
 #include <atomic>
 #include <cmath>
+#include <future>
+#include <stdexcept>
+#include <string>
+#include <utility>
 #include <vector>
 
 #include "../third_party/threadpool/threadpool.h"
 
+#include "./arena.h"
+#include "./cached_keys.h"
+#include "./calibration.h"
+#include "./columnar.h"
+#include "./element_keys.h"
+#include "./external_sort.h"
+#include "./intro_sort.h"
+#include "./knapsack.h"
+#include "./knapsack_session.h"
+#include "./max_plus_knapsack.h"
+#include "./packing.h"
+#include "./radix_sort.h"
+#include "./run_sort.h"
+#include "./selection.h"
+#include "./sort.h"
+#include "./sparse_knapsack.h"
+#include "./trace.h"
 #include "./types.h"
 #include "./utils.h"
 
+/** @brief EggSize - functor providing egg's size to knapsack engines.
+ */
+struct EggSize {
+  uint64_t operator()(Egg& egg) const { return egg.getSize(); }
+};
+
+/** @brief EggWeight - functor providing egg's weight to knapsack engines.
+ */
+struct EggWeight {
+  uint64_t operator()(Egg& egg) const { return egg.getWeight(); }
+};
+
+/** @brief SandStrategy - algorithms used to arrange sand.
+ */
+enum class SandStrategy {
+  kMergeSort,   // Comparison merge sort.
+  kRadixSort,   // Radix sort on grains' sizes, no comparisons.
+  kCachedKeys,  // Sort of cached grains' keys, then permutation of grains.
+  kRunSort,     // Merge of natural runs, linear on sorted grains.
+  kIntroSort    // In-place quicksort, O(log n) extra memory.
+};
+
+/** @brief CrystalStrategy - algorithms used to select best crystal.
+ */
+enum class CrystalStrategy {
+  kCompare,    // Comparisons of crystals.
+  kCachedKeys  // Comparisons of crystals' keys, each computed once.
+};
+
+/** @brief PackingInstance - single packing problem of a batch.
+ */
+struct PackingInstance {
+  PackingInstance(std::vector<Egg>& eggsArg, BottomlessBag& bagArg)
+      : eggs(&eggsArg), bag(&bagArg), result(0) {}
+
+  std::vector<Egg>* eggs;
+  BottomlessBag* bag;
+  // Maximum possible weight of packed eggs, set by packEggsBatch.
+  uint64_t result;
+};
+
+/** @brief PackingSession - packs growing set of eggs into bags.
+ * Adding eggs costs only the new eggs, packing reads the result of any bag
+ * not larger than the maximal one.
+ */
+class PackingSession {
+ public:
+  /** @brief PackingSession - creates session without eggs.
+   * @param maxCapacity   - capacity of the largest bag which will be packed.
+   */
+  explicit PackingSession(uint64_t maxCapacity) : session(maxCapacity) {}
+
+  /** @brief addEggs - adds eggs to the session.
+   * @param eggs[in]   - reference to new eggs' vector.
+   */
+  void addEggs(std::vector<Egg>& eggs) {
+    session.add(eggs.begin(), eggs.end(), EggSize(), EggWeight());
+  }
+
+  /** @brief packEggs - packs all added eggs.
+   * @param bag[in]   - bag not larger than the maximal one.
+   * @return Maximum possible weight of packed eggs.
+   */
+  uint64_t packEggs(BottomlessBag& bag) const {
+    return session.query(bag.getCapacity());
+  }
+
+  /** @brief clear - removes all eggs.
+   */
+  void clear() { session.clear(); }
+
+ private:
+  engines::KnapsackSession session;
+};
+
 class Adventure {
  public:
   virtual ~Adventure() = default;
 
   virtual uint64_t packEggs(std::vector<Egg>& eggs, BottomlessBag& bag) = 0;
 
-  virtual void arrangeSand(std::vector<GrainOfSand>& grains) = 0;
+  /** @brief packEggs - packing eggs given by columns into BottomlessBag.
+   * Columns may be mapped from file, see engines::MappedColumns.
+   * @param sizes[in]      - eggs' sizes;
+   * @param weights[in]    - eggs' weights, in the same order;
+   * @param bag[in, out]   - reference to bag.
+   * @return Maximum possible weight of packed eggs.
+   * Throws std::invalid_argument if columns differ in length.
+   */
+  virtual uint64_t packEggs(engines::Span<uint64_t const> sizes,
+                            engines::Span<uint64_t const> weights,
+                            BottomlessBag& bag) = 0;
+
+  /** @brief packEggs - packing eggs into BottomlessBag approximately.
+   * @param eggs[in]       - reference to eggs' vector;
+   * @param bag[in, out]   - reference to bag;
+   * @param epsilon        - allowed relative error.
+   * @return Weight of packed eggs, at least (1 - @p epsilon) of maximum
+   * possible weight, and upper bound of maximum possible weight.
+   */
+  virtual engines::ApproximateWeight packEggs(std::vector<Egg>& eggs,
+                                              BottomlessBag& bag,
+                                              double epsilon) = 0;
+
+  /** @brief packEggsBatch - solves many packing problems.
+   * @param instances[in, out]   - reference to instances' vector, results
+   * are stored in instances.
+   */
+  virtual void packEggsBatch(std::vector<PackingInstance>& instances) {
+    for (PackingInstance& instance : instances)
+      instance.result = packEggs(*instance.eggs, *instance.bag);
+  }
+
+  /** @brief arrangeSand - arranges grains in place, grains may be vector's
+   * or mapped from file, see engines::mutableColumnView.
+   * @param grains[in, out]   - view of grains.
+   */
+  virtual void arrangeSand(engines::Span<GrainOfSand> grains) = 0;
+
+  /** @brief arrangeSandFile - arranges grains stored in file, which doesn't
+   * have to fit in memory. File holds grains' sizes as native 64-bit
+   * integers. Chunks of file are arranged by arrangeSand, then merged.
+   * @param input[in]       - path of grains' file;
+   * @param output[in]      - path of arranged grains' file, may be @p input;
+   * @param memory          - bytes of memory for grains;
+   * @param directory[in]   - directory of temporary files.
+   * @return Number of arranged grains.
+   */
+  virtual uint64_t arrangeSandFile(std::string const& input,
+                                   std::string const& output, size_t memory,
+                                   std::string const& directory) = 0;
+
+  /** @brief selectBestCrystal - finds crystal with largest shininess,
+   * crystals may be vector's or mapped from file, see engines::columnView.
+   * @param crystals[in]   - view of crystals.
+   * @return Crystal with largest shininess.
+   */
+  virtual Crystal selectBestCrystal(engines::Span<Crystal const> crystals) = 0;
+
+  /** @brief selectBestCrystalIndex - finds position of crystal with largest
+   * shininess, the first one among equally shiny crystals.
+   * @param crystals[in]   - view of crystals.
+   * @return Index of crystal with largest shininess.
+   */
+  virtual size_t selectBestCrystalIndex(
+      engines::Span<Crystal const> crystals) = 0;
+
+  /** @brief selectTopCrystals - finds @p k shiniest crystals without sorting
+   * all of them.
+   * @param crystals[in]   - view of crystals;
+   * @param k              - number of crystals.
+   * @return min(k, n) shiniest crystals, from the shiniest one, earlier
+   * crystals first among equally shiny ones.
+   */
+  virtual std::vector<Crystal> selectTopCrystals(
+      engines::Span<Crystal const> crystals, size_t k) = 0;
+
+  /** @brief setSandStrategy - selects algorithm used by arrangeSand.
+   * @param strategy   - algorithm arranging sand.
+   */
+  void setSandStrategy(SandStrategy strategy) { sandStrategy = strategy; }
+
+  /** @brief setCrystalStrategy - selects algorithm used by selectBestCrystal.
+   * @param strategy   - algorithm selecting crystal.
+   */
+  void setCrystalStrategy(CrystalStrategy strategy) {
+    crystalStrategy = strategy;
+  }
+
+  /** @brief getScratchHighWater - reports memory used by scratch arenas.
+   * @return High water mark in bytes of shared arena, then of each shaman's
+   * arena.
+   */
+  std::vector<size_t> getScratchHighWater() const {
+    return workspace.highWater();
+  }
+
+  /** @brief trimScratch - frees scratch memory and clears high water marks.
+   * @param bytes   - size of memory which each arena may keep.
+   */
+  void trimScratch(size_t bytes) { workspace.trim(bytes); }
 
-  virtual Crystal selectBestCrystal(std::vector<Crystal>& crystals) = 0;
+ protected:
+  // Scratch memory reused by calls, reset at the beginning of each call.
+  engines::Workspace workspace;
+  SandStrategy sandStrategy = SandStrategy::kMergeSort;
+  CrystalStrategy crystalStrategy = CrystalStrategy::kCompare;
 };
 
 class LonesomeAdventure : public Adventure {
@@ -32,101 +231,103 @@ class LonesomeAdventure : public Adventure {
    * @return Maximum possible weight of packed eggs.
    */
   virtual uint64_t packEggs(std::vector<Egg>& eggs, BottomlessBag& bag) {
-    std::vector<std::vector<uint64_t>> vec;
-    vec.resize(eggs.size());
-    for (size_t i = 0; i < vec.size(); i++)
-      vec[i].resize(bag.getCapacity() + 1);
-    for (uint64_t i = eggs[0].getSize(); i <= bag.getCapacity(); i++)
-      vec[0][i] = eggs[0].getWeight();
-    for (uint64_t i = 1; i < eggs.size(); i++) {
-      for (uint64_t j = 0; j <= bag.getCapacity(); j++) {
-        if (j < eggs[i].getSize()) {
-          if (j != 0) {
-            vec[i][j] = std::max(vec[i - 1][j], vec[i][j - 1]);
-          } else {
-            vec[i][j] = vec[i - 1][j];
-          }
-        } else {
-          if (j != 0) {
-            vec[i][j] = std::max(vec[i][j - 1], vec[i - 1][j]);
-          } else {
-            vec[i][j] = vec[i - 1][j];
-          }
-          vec[i][j] = std::max(vec[i][j], vec[i - 1][j - eggs[i].getSize()] +
-                                              eggs[i].getWeight());
-        }
-      }
-    }
-    return vec[eggs.size() - 1][bag.getCapacity()];
+    TRACE_SCOPE("lonesome packEggs", eggs.size());
+    workspace.reset();
+    return engines::packKnapsack(eggs.begin(), eggs.end(), bag.getCapacity(),
+                                 EggSize(), EggWeight(), &workspace.shared());
+  }
+
+  virtual uint64_t packEggs(engines::Span<uint64_t const> sizes,
+                            engines::Span<uint64_t const> weights,
+                            BottomlessBag& bag) {
+    if (sizes.size() != weights.size())
+      throw std::invalid_argument("Columns differ in length");
+    TRACE_SCOPE("lonesome column packEggs", sizes.size());
+    workspace.reset();
+    return engines::packKnapsack(
+        sizes.begin(), sizes.end(), bag.getCapacity(), engines::ColumnSize(),
+        engines::ColumnWeight{sizes.data(), weights.data()},
+        &workspace.shared());
+  }
+
+  virtual engines::ApproximateWeight packEggs(std::vector<Egg>& eggs,
+                                              BottomlessBag& bag,
+                                              double epsilon) {
+    TRACE_SCOPE("lonesome approximate packEggs", eggs.size());
+    workspace.reset();
+    return engines::packApproximately(eggs.begin(), eggs.end(),
+                                      bag.getCapacity(), EggSize(),
+                                      EggWeight(), epsilon,
+                                      &workspace.shared());
   }
 
   /** @brief arrangeSand - Arranges sand's grains from smallest to largerst.
-   * @param grains[in, out]   - reference to grains' vector.
+   * @param grains[in, out]   - view of grains.
    */
-  virtual void arrangeSand(std::vector<GrainOfSand>& grains) {
-    mergeSort(grains, 0, grains.size() - 1);
+  virtual void arrangeSand(engines::Span<GrainOfSand> grains) {
+    TRACE_SCOPE("lonesome arrangeSand", grains.size());
+    workspace.reset();
+    switch (sandStrategy) {
+      case SandStrategy::kRadixSort:
+        engines::sortByKey(grains.begin(), grains.end(),
+                           std::less<GrainOfSand>());
+        break;
+      case SandStrategy::kCachedKeys:
+        engines::cachedKeySort(grains.begin(), grains.end(), GrainKey());
+        break;
+      case SandStrategy::kRunSort:
+        engines::runSort(grains.begin(), grains.end(),
+                         std::less<GrainOfSand>(), &workspace.shared());
+        break;
+      case SandStrategy::kIntroSort:
+        engines::introSort(grains.begin(), grains.end(),
+                           std::less<GrainOfSand>());
+        break;
+      default:
+        engines::mergeSort(grains.begin(), grains.end(),
+                           std::less<GrainOfSand>(), &workspace.shared());
+    }
+  }
+
+  virtual uint64_t arrangeSandFile(std::string const& input,
+                                   std::string const& output, size_t memory,
+                                   std::string const& directory) {
+    TRACE_SCOPE("lonesome arrangeSandFile", memory);
+    return engines::externalSort<GrainOfSand>(
+        nullptr, input, output, memory, directory,
+        engines::KeyLess<GrainOfSand>(),
+        [this](std::vector<GrainOfSand>& grains) { arrangeSand(grains); });
   }
 
   /** @brief selectBestCrystal - finds crystal with largest shininess.
-   * @param crystals[in]   - reference to crystals' vector.
+   * @param crystals[in]   - view of crystals.
    * @return Crystal with largest shininess.
    */
-  virtual Crystal selectBestCrystal(std::vector<Crystal>& crystals) {
-    if (crystals.size() == 0) throw std::runtime_error("No crystals");
-    Crystal bestCrystal = crystals[0];
-    for (size_t i = 1; i < crystals.size(); i++) {
-      bestCrystal = std::max(bestCrystal, crystals[i]);
-    }
-    return bestCrystal;
+  virtual Crystal selectBestCrystal(engines::Span<Crystal const> crystals) {
+    return crystals[selectBestCrystalIndex(crystals)];
   }
 
- private:
-  /** @brief merge - merges two sorted sub arrays to increasing sequnce.
-   * @param grains[in, out]   - reference to grainns' vector;
-   * @param l                 - first index of first sub array;
-   * @param m                 - last index of first sub array;
-   * @param r                 - last index of second sub array.
-   */
-  void merge(std::vector<GrainOfSand>& grains, size_t l, size_t m, size_t r) {
-    std::vector<GrainOfSand> left, right;
-    for (size_t i = 0; i < m - l + 1; i++) left.push_back(grains[l + i]);
-    for (size_t i = 0; i < r - m; i++) right.push_back(grains[m + i + 1]);
-    size_t i = 0, j = 0;
-    size_t pos = l;
-    while (i < left.size() && j < right.size()) {
-      if (left[i] < right[j]) {
-        grains[pos] = left[i];
-        i++;
-      } else {
-        grains[pos] = right[j];
-        j++;
-      }
-      pos++;
-    }
-    while (i < left.size()) {
-      grains[pos] = left[i];
-      i++;
-      pos++;
-    }
-    while (j < right.size()) {
-      grains[pos] = right[j];
-      j++;
-      pos++;
-    }
+  virtual size_t selectBestCrystalIndex(
+      engines::Span<Crystal const> crystals) {
+    if (crystals.size() == 0) throw std::runtime_error("No crystals");
+    TRACE_SCOPE("lonesome selectBestCrystal", crystals.size());
+    if (crystalStrategy == CrystalStrategy::kCachedKeys)
+      return engines::cachedKeyMaxElement(crystals.begin(), crystals.end(),
+                                          CrystalKey()) -
+             crystals.begin();
+    return engines::maxElement(crystals.begin(), crystals.end(),
+                               std::less<Crystal>()) -
+           crystals.begin();
   }
 
-  /** @brief mergeSort - sorts given grains' sub array.
-   * @param grains[in, out]   - reference to grains' vector;
-   * @param l                 - first index of sub array;
-   * @param r                 - last index of sub array.
-   */
-  void mergeSort(std::vector<GrainOfSand>& grains, size_t l, size_t r) {
-    if (l < r) {
-      size_t m = (l + r) / 2;
-      mergeSort(grains, l, m);
-      mergeSort(grains, m + 1, r);
-      merge(grains, l, m, r);
-    }
+  virtual std::vector<Crystal> selectTopCrystals(
+      engines::Span<Crystal const> crystals, size_t k) {
+    TRACE_SCOPE("lonesome selectTopCrystals", crystals.size());
+    std::vector<Crystal> top;
+    for (Crystal const* crystal : engines::topElements(
+             crystals.begin(), crystals.end(), k, std::less<Crystal>()))
+      top.push_back(*crystal);
+    return top;
   }
 };
 
@@ -134,7 +335,42 @@ class TeamAdventure : public Adventure {
  public:
   explicit TeamAdventure(uint64_t numberOfShamansArg)
       : numberOfShamans(numberOfShamansArg),
-        councilOfShamans(numberOfShamansArg) {}
+        councilOfShamans(numberOfShamansArg),
+        tuning(calibration::defaultTuning()) {
+    workspace.attach(&councilOfShamans, numberOfShamans);
+  }
+
+  /** @brief setTuning - replaces costs used to split work among shamans.
+   * @param tuningArg[in]   - measured or loaded tuning.
+   */
+  void setTuning(calibration::Tuning const& tuningArg) { tuning = tuningArg; }
+
+  calibration::Tuning const& getTuning() const { return tuning; }
+
+  /** @brief getCouncilMetrics - provides shamans' runtime counters.
+   * Counters are collected only when compiled with THREADPOOL_METRICS.
+   * @return Counters of each shaman.
+   */
+  std::vector<ThreadPool::Metrics> getCouncilMetrics() {
+    return councilOfShamans.metrics();
+  }
+
+  /** @brief dumpCouncilMetrics - periodically writes shamans' counters.
+   * @param out[in, out]   - output stream or nullptr to stop dumping;
+   * @param period         - time between dumps.
+   */
+  void dumpCouncilMetrics(std::ostream* out,
+                          std::chrono::milliseconds period) {
+    councilOfShamans.setMetricsDump(out, period);
+  }
+
+  /** @brief touchColumns - faults mapped file in with all shamans, so that
+   * following calls don't stall on the disk.
+   * @param file[in, out]   - mapped file.
+   */
+  void touchColumns(engines::MappedColumns& file) {
+    file.touch(councilOfShamans, numberOfShamans);
+  }
 
   /** @brief packEggs - packing egss into BottomlessBag with extra workers.
    * @param eggs[in]       - reference to eggs' vector
@@ -142,285 +378,310 @@ class TeamAdventure : public Adventure {
    * @return Maximum possible weight of packed eggs.
    */
   uint64_t packEggs(std::vector<Egg>& eggs, BottomlessBag& bag) {
-    std::vector<std::vector<uint64_t>> vec;
-    std::vector<std::vector<std::promise<uint64_t>>> promises;
-    std::vector<std::vector<std::future<uint64_t>>> futures;
-    vec.resize(eggs.size());
-    promises.resize(eggs.size());
-    futures.resize(eggs.size());
-    for (size_t i = 0; i < eggs.size(); i++) {
-      vec[i].resize(bag.getCapacity() + 1);
-      promises[i].resize(numberOfShamans);
-      futures[i].resize(numberOfShamans);
-      for (uint64_t j = 0; j < numberOfShamans; j++)
-        futures[i][j] = promises[i][j].get_future();
+    TRACE_SCOPE("team packEggs", eggs.size());
+    workspace.reset();
+    return packWithCouncil(eggs, bag.getCapacity());
+  }
+
+  /** @brief packEggs - packing eggs given by columns into BottomlessBag with
+   * extra workers.
+   * @param sizes[in]      - eggs' sizes;
+   * @param weights[in]    - eggs' weights, in the same order;
+   * @param bag[in, out]   - reference to bag.
+   * @return Maximum possible weight of packed eggs.
+   */
+  uint64_t packEggs(engines::Span<uint64_t const> sizes,
+                    engines::Span<uint64_t const> weights, BottomlessBag& bag) {
+    if (sizes.size() != weights.size())
+      throw std::invalid_argument("Columns differ in length");
+    TRACE_SCOPE("team column packEggs", sizes.size());
+    workspace.reset();
+    typedef engines::KnapsackItem Item;
+    uint64_t capacity = bag.getCapacity();
+    engines::Arena* shared = &workspace.shared();
+    engines::ArenaScope scope(shared);
+    engines::ScratchVector<Item> items{engines::ArenaAllocator<Item>(shared)};
+    uint64_t packed = engines::prepareItems(
+        sizes.begin(), sizes.end(), capacity, engines::ColumnSize(),
+        engines::ColumnWeight{sizes.data(), weights.data()}, items);
+    return packed + solveWithCouncil(items, capacity);
+  }
+
+  /** @brief packEggs - packing eggs into BottomlessBag approximately with
+   * extra workers. Table over scaled weights is filled sequentially, exact
+   * solution is used when it would be cheaper.
+   * @param eggs[in]       - reference to eggs' vector;
+   * @param bag[in, out]   - reference to bag;
+   * @param epsilon        - allowed relative error.
+   * @return Weight of packed eggs, at least (1 - @p epsilon) of maximum
+   * possible weight, and upper bound of maximum possible weight.
+   */
+  engines::ApproximateWeight packEggs(std::vector<Egg>& eggs,
+                                      BottomlessBag& bag, double epsilon) {
+    TRACE_SCOPE("team approximate packEggs", eggs.size());
+    workspace.reset();
+    typedef engines::KnapsackItem Item;
+    uint64_t capacity = bag.getCapacity();
+    engines::Arena* shared = &workspace.shared();
+    engines::ArenaScope scope(shared);
+    engines::ScratchVector<Item> items{engines::ArenaAllocator<Item>(shared)};
+    uint64_t packed = engines::prepareItems(eggs.begin(), eggs.end(), capacity,
+                                            EggSize(), EggWeight(), items);
+    if (engines::approximationPays(items.begin(), items.end(), capacity,
+                                   engines::ItemSize(), engines::ItemWeight(),
+                                   epsilon)) {
+      engines::ApproximateWeight result = engines::approximateKnapsack(
+          items.begin(), items.end(), capacity, engines::ItemSize(),
+          engines::ItemWeight(), epsilon, shared);
+      return {packed + result.weight, packed + result.bound};
     }
-    uint64_t mod = (bag.getCapacity() + 1) % numberOfShamans;
-    uint64_t work_size = (bag.getCapacity() + 1) / numberOfShamans;
-    uint64_t first = 0;
-    uint64_t last = work_size - 1;
-    // Distributing the work to shamans.
-    for (uint64_t i = 0; i < numberOfShamans; i++) {
-      if (i < mod) last++;
-      councilOfShamans.enqueue(knapsack, std::ref(promises), std::ref(futures),
-                               std::ref(eggs), std::ref(vec), first, last, i);
-      first = last + 1;
-      last += work_size;
+    uint64_t exact = packed + solveWithCouncil(items, capacity);
+    return {exact, exact};
+  }
+
+  /** @brief packEggsBatch - solves many packing problems with extra workers.
+   * Instances worth splitting among shamans are solved one by one with all
+   * of them, other instances are solved in parallel, each by single shaman.
+   * @param instances[in, out]   - reference to instances' vector, results
+   * are stored in instances.
+   */
+  void packEggsBatch(std::vector<PackingInstance>& instances) {
+    TRACE_SCOPE("team packEggsBatch", instances.size());
+    workspace.reset();
+    std::vector<PackingInstance*> small;
+    double workNs = 0, largestNs = 0;
+    for (PackingInstance& instance : instances) {
+      uint64_t capacity = instance.bag->getCapacity();
+      uint64_t items = instance.eggs->size();
+      if (calibration::knapsackWorkers(tuning, items, capacity,
+                                       numberOfShamans) > 1 ||
+          calibration::itemSplitWorkers(tuning, items, capacity,
+                                        numberOfShamans) > 1) {
+        instance.result = packWithCouncil(*instance.eggs, capacity);
+        continue;
+      }
+      // Sparse engines are estimated by the largest dense table.
+      double costNs =
+          tuning.knapsackNs * std::min<double>(items * (capacity + 1.0),
+                                               engines::kMaxDenseCells);
+      workNs += costNs;
+      largestNs = std::max(largestNs, costNs);
+      small.push_back(&instance);
     }
-    // Waiting for result.
-    futures[eggs.size() - 1][numberOfShamans - 1].get();
-    return vec[eggs.size() - 1][bag.getCapacity()];
+    uint64_t used_shamans = calibration::batchWorkers(
+        tuning, workNs, largestNs, small.size(), numberOfShamans);
+    // Shamans take next unsolved instance until none is left.
+    std::atomic<size_t> next(0);
+    engines::Workspace* scratch = &workspace;
+    auto solve = [&small, &next, scratch]() {
+      TRACE_SCOPE("batch shaman", small.size());
+      for (size_t i = next++; i < small.size(); i = next++) {
+        PackingInstance& instance = *small[i];
+        instance.result = engines::packKnapsack(
+            instance.eggs->begin(), instance.eggs->end(),
+            instance.bag->getCapacity(), EggSize(), EggWeight(),
+            engines::localArena(scratch));
+      }
+    };
+    if (used_shamans == 1) return solve();
+    std::vector<std::future<void>> done;
+    for (uint64_t i = 0; i < used_shamans; i++)
+      done.push_back(councilOfShamans.enqueue(solve));
+    for (auto& future : done) future.get();
   }
 
   /** @brief arrangeSand - Arranges sand's grains from smallest to largest.
-   * @param grains[in, out]   - reference to grains' vector.
-   */
-  virtual void arrangeSand(std::vector<GrainOfSand>& grains) {
-    std::vector<std::pair<uint64_t, uint64_t>> ranges;
-    std::vector<std::promise<bool>> promises;
-    std::vector<std::future<bool>> futures;
-    uint64_t leafs = 1;
-    uint64_t position = 1;
-    ranges.push_back({0, 0});
-    promises.push_back(std::promise<bool>());
-    futures.push_back(std::future<bool>());
-    ranges.push_back({0, grains.size() - 1});
-    promises.push_back(std::promise<bool>());
-    futures.push_back(promises[1].get_future());
-    // Distributing the work to shamans.
-    while (leafs < numberOfShamans &&
-           ranges[position].second - ranges[position].first != 0) {
-      uint64_t m = (ranges[position].first + ranges[position].second) / 2;
-      ranges.push_back({ranges[position].first, m});
-      promises.push_back(std::promise<bool>());
-      futures.push_back(promises[2 * position].get_future());
-      ranges.push_back({m + 1, ranges[position].second});
-      promises.push_back(std::promise<bool>());
-      futures.push_back(promises[2 * position + 1].get_future());
-      leafs++;
-      position++;
-    }
-    size_t k = ranges.size() - 1;
-    position = k;
-    for (size_t i = 0; i < leafs; i++) {
-      councilOfShamans.enqueue(mergeSortWrapper, std::ref(grains),
-                               ranges[k - i].first, ranges[k - i].second,
-                               std::ref(promises[k - i]));
-    }
-    // Merging sub results when it's possible.
-    for (int i = ranges.size() - 1; i > 0; i -= 2) {
-      if (i == 1) break;
-      futures[i].get();
-      futures[i - 1].get();
-      councilOfShamans.enqueue(merge, std::ref(grains), ranges[i - 1].first,
-                               ranges[i - 1].second, ranges[i].second,
-                               std::ref(promises[i / 2]));
+   * @param grains[in, out]   - view of grains.
+   */
+  virtual void arrangeSand(engines::Span<GrainOfSand> grains) {
+    TRACE_SCOPE("team arrangeSand", grains.size());
+    uint64_t used_shamans = calibration::sortWorkers(
+        tuning, sandSortNs(), grains.size(), numberOfShamans);
+    workspace.reset();
+    switch (sandStrategy) {
+      case SandStrategy::kRadixSort:
+        engines::parallelSortByKey(councilOfShamans, used_shamans,
+                                   grains.begin(), grains.end(),
+                                   std::less<GrainOfSand>());
+        break;
+      case SandStrategy::kCachedKeys:
+        engines::parallelCachedKeySort(councilOfShamans, used_shamans,
+                                       grains.begin(), grains.end(),
+                                       GrainKey());
+        break;
+      case SandStrategy::kRunSort:
+        engines::parallelRunSort(councilOfShamans, used_shamans,
+                                 grains.begin(), grains.end(),
+                                 std::less<GrainOfSand>(), &workspace);
+        break;
+      case SandStrategy::kIntroSort:
+        engines::parallelIntroSort(councilOfShamans, used_shamans,
+                                   grains.begin(), grains.end(),
+                                   std::less<GrainOfSand>());
+        break;
+      default:
+        engines::parallelMergeSort(councilOfShamans, used_shamans,
+                                   grains.begin(), grains.end(),
+                                   std::less<GrainOfSand>(), &workspace);
     }
-    // Waiting for result.
-    futures[1].get();
+  }
+
+  /** @brief arrangeSandFile - arranges grains stored in file, see
+   * @ref Adventure::arrangeSandFile. Shamans arrange chunks, read and write
+   * files while the caller merges.
+   */
+  virtual uint64_t arrangeSandFile(std::string const& input,
+                                   std::string const& output, size_t memory,
+                                   std::string const& directory) {
+    TRACE_SCOPE("team arrangeSandFile", memory);
+    return engines::externalSort<GrainOfSand>(
+        &councilOfShamans, input, output, memory, directory,
+        engines::KeyLess<GrainOfSand>(),
+        [this](std::vector<GrainOfSand>& grains) { arrangeSand(grains); });
   }
 
   /** @brief selectBestCrystal - finds crystal with largest shininess.
-   * @param crystals[in]   - reference to crystals' vector.
+   * @param crystals[in]   - view of crystals.
    * @return Crystal with largest shininess.
    */
-  virtual Crystal selectBestCrystal(std::vector<Crystal>& crystals) {
+  virtual Crystal selectBestCrystal(engines::Span<Crystal const> crystals) {
+    return crystals[selectBestCrystalIndex(crystals)];
+  }
+
+  /** @brief selectBestCrystalIndex - finds position of the first shiniest
+   * crystal, each shaman scanning its chunk.
+   * @param crystals[in]   - view of crystals.
+   * @return Index of crystal with largest shininess.
+   */
+  virtual size_t selectBestCrystalIndex(
+      engines::Span<Crystal const> crystals) {
     if (crystals.size() == 0) throw std::runtime_error("No crystals");
+    TRACE_SCOPE("team selectBestCrystal", crystals.size());
     // Setting optimal number of shamans to avoid situation when each worker
     // get too few work and communication's costs are too high.
-    uint64_t used_shamans = std::min(numberOfShamans, getSqrt(crystals.size()));
-    if (numberOfShamans - used_shamans <= 32) used_shamans = numberOfShamans;
-    uint64_t mod = crystals.size() % used_shamans;
-    uint64_t work_size = crystals.size() / used_shamans;
-    std::vector<std::promise<Crystal>> promises;
-    std::vector<std::future<Crystal>> futures;
-    promises.resize(numberOfShamans);
-    for (uint64_t i = 0; i < used_shamans; i++)
-      futures.push_back(promises[i].get_future());
-
-    if (work_size == 0) {
-      for (size_t i = 0; i < crystals.size(); i++)
-        promises[i].set_value(crystals[i]);
-    } else {
-      uint64_t first = 0;
-      uint64_t last = work_size - 1;
-      // Distributing the work.
-      for (uint64_t i = 0; i < used_shamans; i++) {
-        if (i < mod) last++;
-        councilOfShamans.enqueue(bestCrystalPartial, first, last,
-                                 std::ref(promises[i]), std::ref(crystals));
-        first = last + 1;
-        last += work_size;
-      }
-    }
-    Crystal bestCrystal = futures[0].get();
-    for (uint64_t i = 1; i < std::min(used_shamans, crystals.size()); i++)
-      bestCrystal = std::max(futures[i].get(), bestCrystal);
-    return bestCrystal;
-  }
-
- private:
-  /** @brief bestCrystalPartial - Function to execute for each worker.
-   * Finds best crystal in given sub array.
-   * @param beg            - first index of subarray;
-   * @param end            - last index of sub array;
-   * @param promise        - promise to fullfill with result;
-   * @param crystals[in]   - reference to crystals' vector.
-   */
-  static void bestCrystalPartial(uint64_t beg, uint64_t end,
-                                 std::promise<Crystal>& promise,
-                                 std::vector<Crystal>& crystals) {
-    Crystal bestCrystal = crystals[beg];
-    for (uint64_t i = beg + 1; i <= end; i++)
-      bestCrystal = std::max(bestCrystal, crystals[i]);
-    promise.set_value(bestCrystal);
+    uint64_t used_shamans =
+        calibration::selectWorkers(tuning, crystals.size(), numberOfShamans);
+    workspace.reset();
+    if (crystalStrategy == CrystalStrategy::kCachedKeys)
+      return engines::parallelCachedKeyMaxElement(
+                 councilOfShamans, used_shamans, crystals.begin(),
+                 crystals.end(), CrystalKey()) -
+             crystals.begin();
+    return engines::parallelMaxElement(councilOfShamans, used_shamans,
+                                       crystals.begin(), crystals.end(),
+                                       std::less<Crystal>(), &workspace) -
+           crystals.begin();
   }
 
-  uint64_t getSqrt(size_t s) {
-    uint64_t ret = 0;
-    while (ret * ret < s) ret++;
-    return ret;
+  /** @brief selectTopCrystals - finds @p k shiniest crystals, each shaman
+   * keeping heap of its chunk's best crystals, chunks are merged by
+   * tournament.
+   * @param crystals[in]   - view of crystals;
+   * @param k              - number of crystals.
+   * @return min(k, n) shiniest crystals, from the shiniest one.
+   */
+  virtual std::vector<Crystal> selectTopCrystals(
+      engines::Span<Crystal const> crystals, size_t k) {
+    TRACE_SCOPE("team selectTopCrystals", crystals.size());
+    uint64_t used_shamans =
+        calibration::selectWorkers(tuning, crystals.size(), numberOfShamans);
+    std::vector<Crystal> top;
+    for (Crystal const* crystal : engines::parallelTopElements(
+             councilOfShamans, used_shamans, crystals.begin(), crystals.end(),
+             k, std::less<Crystal>()))
+      top.push_back(*crystal);
+    return top;
   }
 
-  /** @brief mergeSortWrapper - Wrapper for parallel merge sort.
-   * Execute sequence mergeSort and fullfill promise when work was finished.
-   * @param grains[in, out]   - reference to grains' vector;
-   * @param l                 - first index of grains' subarray;
-   * @param r                 - last index of grains' subarray;
-   * @param promise[in, out]  - reference to promise.
-   */
-  static void mergeSortWrapper(std::vector<GrainOfSand>& grains, size_t l,
-                               size_t r, std::promise<bool>& promise) {
-    mergeSort(grains, l, r);
-    promise.set_value(true);
+ private:
+  /** @brief sandSortNs - measured cost of algorithm arranging sand.
+   * @return Cost per element and level of merge sort.
+   */
+  double sandSortNs() const {
+    switch (sandStrategy) {
+      case SandStrategy::kRadixSort:
+        return tuning.radixSortNs;
+      case SandStrategy::kCachedKeys:
+        return tuning.cachedKeySortNs;
+      case SandStrategy::kRunSort:
+        return tuning.runSortNs;
+      case SandStrategy::kIntroSort:
+        return tuning.introSortNs;
+      default:
+        return tuning.sortNs;
+    }
   }
 
-  /** @brief mergeSort - Sequence mergeSort for given subarray.
-   * @param grains[in, out]   - reference to grains' vector;
-   * @param l                 - first index of subarray;
-   * @param r                 - last index of subarray.
-   */
-  static void mergeSort(std::vector<GrainOfSand>& grains, size_t l, size_t r) {
-    if (l < r) {
-      size_t m = (l + r) / 2;
-      mergeSort(grains, l, m);
-      mergeSort(grains, m + 1, r);
-      // Merging sorted sub arrays.
-      std::vector<GrainOfSand> left, right;
-      for (size_t i = 0; i < m - l + 1; i++) left.push_back(grains[l + i]);
-      for (size_t i = 0; i < r - m; i++) right.push_back(grains[m + i + 1]);
-      size_t i = 0, j = 0;
-      size_t pos = l;
-      while (i < left.size() && j < right.size()) {
-        if (left[i] < right[j]) {
-          grains[pos] = left[i];
-          i++;
-        } else {
-          grains[pos] = right[j];
-          j++;
-        }
-        pos++;
-      }
-      while (i < left.size()) {
-        grains[pos] = left[i];
-        i++;
-        pos++;
-      }
-      while (j < right.size()) {
-        grains[pos] = right[j];
-        j++;
-        pos++;
-      }
-    }
+  /** @brief packWithCouncil - prepares eggs and packs them with shamans.
+   * @param eggs[in]   - reference to eggs' vector;
+   * @param capacity   - capacity of bag.
+   * @return Maximum possible weight of packed eggs.
+   */
+  uint64_t packWithCouncil(std::vector<Egg>& eggs, uint64_t capacity) {
+    typedef engines::KnapsackItem Item;
+    engines::Arena* shared = &workspace.shared();
+    engines::ArenaScope scope(shared);
+    engines::ScratchVector<Item> items{engines::ArenaAllocator<Item>(shared)};
+    uint64_t packed = engines::prepareItems(eggs.begin(), eggs.end(), capacity,
+                                            EggSize(), EggWeight(), items);
+    return packed + solveWithCouncil(items, capacity);
   }
 
-  /** @brief merge - Merges two sorted sub arrays sequentially.
-   * @param grains[in, out]   - reference to grains vector;
-   * @param l                 - first index of first sub array;
-   * @param m                 - last index of first sub array;
-   * @param r                 - last index of second sub array;
-   * @param promise[in, out]  - promise to fullfill when work finished.
-   */
-  static void merge(std::vector<GrainOfSand>& grains, size_t l, size_t m,
-                    size_t r, std::promise<bool>& promise) {
-    std::vector<GrainOfSand> left, right;
-    for (size_t i = 0; i < m - l + 1; i++) left.push_back(grains[l + i]);
-    for (size_t i = 0; i < r - m; i++) right.push_back(grains[m + i + 1]);
-    size_t i = 0, j = 0;
-    size_t pos = l;
-    while (i < left.size() && j < right.size()) {
-      if (left[i] < right[j]) {
-        grains[pos] = left[i];
-        i++;
-      } else {
-        grains[pos] = right[j];
-        j++;
-      }
-      pos++;
-    }
-    while (i < left.size()) {
-      grains[pos] = left[i];
-      i++;
-      pos++;
-    }
-    while (j < right.size()) {
-      grains[pos] = right[j];
-      j++;
-      pos++;
+  /** @brief solveWithCouncil - packs prepared items with shamans.
+   * Only dense table and bitsets are split among shamans.
+   * @param items[in]   - prepared items;
+   * @param capacity    - capacity of bag.
+   * @return Maximum possible weight of packed items.
+   */
+  uint64_t solveWithCouncil(
+      engines::ScratchVector<engines::KnapsackItem>& items,
+      uint64_t capacity) {
+    engines::KnapsackEngine engine = engines::chooseKnapsackEngine(
+        items.begin(), items.end(), capacity, engines::ItemSize(),
+        engines::ItemWeight());
+    switch (engine) {
+      case engines::KnapsackEngine::kSubsetSum:
+        return engines::parallelSubsetSumKnapsack(
+            councilOfShamans,
+            calibration::knapsackWorkers(tuning, items.size(), capacity / 64,
+                                         numberOfShamans),
+            items.begin(), items.end(), capacity, engines::ItemSize(),
+            engines::ItemWeight(), &workspace);
+      case engines::KnapsackEngine::kDense:
+        return packDense(items, capacity);
+      default:
+        return engines::solveKnapsack(engine, items.begin(), items.end(),
+                                      capacity, engines::ItemSize(),
+                                      engines::ItemWeight(),
+                                      &workspace.shared());
     }
-    promise.set_value(true);
   }
 
-  /** @brief knapsack - Partially solves knapsack problem.
-   * Columns represent maximum possible weight of eggs not exceed bag's
-   * capacity. Rows represent used eggs. Each worker solves problem for
-   * given columns. Worker starts fullfilling n-th row, when previous
-   * worker finished (n-1)-th row and inform when it finished row.
-   * @param promises[in, out]   - reference to promises' vector;
-   * @param futures[in, out]    - reference to futures' vector;
-   * @param eggs[in]            - reference to eggs' vector;
-   * @param vec                 - reference to vector with partial results;
-   * @param beg                 - index of first column;
-   * @param end                 - index of last column;
-   * @param num                 - number of worker.
-   */
-  static void knapsack(
-      std::vector<std::vector<std::promise<uint64_t>>>& promises,
-      std::vector<std::vector<std::future<uint64_t>>>& futures,
-      std::vector<Egg>& eggs, std::vector<std::vector<uint64_t>>& vec,
-      uint64_t beg, uint64_t end, uint64_t num) {
-    if (num != 0) futures[0][num - 1].get();
-    for (size_t i = std::max(beg, eggs[0].getSize()); i <= end; i++) {
-      vec[0][i] = eggs[0].getWeight();
-    }
-    promises[0][num].set_value(1);
-    for (size_t i = 1; i < eggs.size(); i++) {
-      // Waiting until previous worker finish row.
-      if (num != 0) futures[i][num - 1].get();
-      for (uint64_t j = beg; j <= end; j++) {
-        if (j < eggs[i].getSize()) {
-          if (j != 0) {
-            vec[i][j] = std::max(vec[i - 1][j], vec[i][j - 1]);
-          } else {
-            vec[i][j] = vec[i - 1][j];
-          }
-        } else {
-          if (j != 0) {
-            vec[i][j] = std::max(vec[i][j - 1], vec[i - 1][j]);
-          } else {
-            vec[i][j] = vec[i - 1][j];
-          }
-          vec[i][j] = std::max(vec[i][j], vec[i - 1][j - eggs[i].getSize()] +
-                                              eggs[i].getWeight());
-        }
-      }
-      // Notifying about finished row.
-      promises[i][num].set_value(1);
-    }
+  /** @brief packDense - fills dense table with shamans splitting columns
+   * or, for many items and small capacity, splitting items.
+   * @param items[in]   - prepared items;
+   * @param capacity    - capacity of bag.
+   * @return Maximum possible weight of packed items.
+   */
+  uint64_t packDense(engines::ScratchVector<engines::KnapsackItem>& items,
+                     uint64_t capacity) {
+    uint64_t columns = calibration::knapsackWorkers(
+        tuning, items.size(), capacity, numberOfShamans);
+    uint64_t groups = calibration::itemSplitWorkers(
+        tuning, items.size(), capacity, numberOfShamans);
+    if (calibration::itemSplitNs(tuning, items.size(), capacity, groups) <
+        calibration::columnSplitNs(tuning, items.size(), capacity, columns))
+      return engines::itemParallelKnapsack(
+          councilOfShamans, groups, items.begin(), items.end(), capacity,
+          engines::ItemSize(), engines::ItemWeight(), &workspace);
+    return engines::parallelKnapsack(councilOfShamans, columns, items.begin(),
+                                     items.end(), capacity, engines::ItemSize(),
+                                     engines::ItemWeight(), &workspace);
   }
 
   uint64_t numberOfShamans;
   ThreadPool councilOfShamans;
+  calibration::Tuning tuning;
 };
 
 #endif  // SRC_ADVENTURE_H_
@@ -0,0 +1,118 @@
+#ifndef SRC_APPROXIMATE_KNAPSACK_H_
+#define SRC_APPROXIMATE_KNAPSACK_H_
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "./arena.h"
+#include "./sparse_knapsack.h"
+#include "./trace.h"
+
+namespace engines {
+
+/** @brief ApproximateWeight - weight of packed items and bound of optimum.
+ */
+struct ApproximateWeight {
+  uint64_t weight;  // Weight of items which really fit.
+  uint64_t bound;   // Maximum possible weight is not larger.
+};
+
+/** @brief profitScale - unit of scaled weights guaranteeing relative error.
+ * Rounding down weights loses less than the unit per item, so n units must
+ * not exceed @p epsilon of the heaviest item, which alone is a lower bound of
+ * optimum. Unit below 1 wouldn't shrink anything.
+ * @param first     - beginning of items' range, each item must fit;
+ * @param last      - end of items' range;
+ * @param weight    - functor providing item's weight;
+ * @param epsilon   - allowed relative error.
+ * @return Unit of scaled weights, at least 1.
+ */
+template <class RandomIt, class WeightFn>
+double profitScale(RandomIt first, RandomIt last, WeightFn weight,
+                   double epsilon) {
+  uint64_t heaviest = 0;
+  for (RandomIt it = first; it != last; ++it)
+    heaviest = std::max(heaviest, weight(*it));
+  double n = static_cast<double>(std::max<uint64_t>(1, last - first));
+  return std::max(1.0, epsilon * heaviest / n);
+}
+
+/** @brief scaledProfits - sum of weights in units of @p scale.
+ * @return Sum of scaled weights rounded down.
+ */
+template <class RandomIt, class WeightFn>
+double scaledProfits(RandomIt first, RandomIt last, WeightFn weight,
+                     double scale) {
+  double total = 0;
+  for (RandomIt it = first; it != last; ++it)
+    total += std::floor(weight(*it) / scale);
+  return total;
+}
+
+/** @brief approximationPays - checks if trimmed Pareto front is cheaper than
+ * exact algorithm. Trimmed front keeps at most one state per unit of scaled
+ * weight and never more states than exact front.
+ * @param first      - beginning of items' range, each item must fit;
+ * @param last       - end of items' range;
+ * @param capacity   - capacity of knapsack;
+ * @param size       - functor providing item's size;
+ * @param weight     - functor providing item's weight;
+ * @param epsilon    - allowed relative error.
+ * @return True if approximation is cheaper than exact solution.
+ */
+template <class RandomIt, class SizeFn, class WeightFn>
+bool approximationPays(RandomIt first, RandomIt last, uint64_t capacity,
+                       SizeFn size, WeightFn weight, double epsilon) {
+  double scale = profitScale(first, last, weight, epsilon);
+  if (!(scale > 1)) return false;
+  KnapsackEngine engine =
+      chooseKnapsackEngine(first, last, capacity, size, weight);
+  if (engine == KnapsackEngine::kAll) return false;
+  uint64_t n = last - first;
+  double buckets = scaledProfits(first, last, weight, scale) + 1;
+  double trimmed = std::min(knapsackWork(KnapsackEngine::kPareto, n, capacity),
+                            kSparseStateCost * n * buckets);
+  return trimmed < knapsackWork(engine, n, capacity);
+}
+
+/** @brief approximateKnapsack - solves knapsack problem within relative
+ * error @p epsilon (FPTAS). Pareto front is trimmed to one state per unit of
+ * @ref profitScale, so it has O(n / epsilon) states. Each item loses less
+ * than the unit, so n units, at most @p epsilon of the heaviest item, bound
+ * the error. When exact algorithm is cheaper, it is used instead.
+ * @param first      - beginning of items' range, each item must fit;
+ * @param last       - end of items' range;
+ * @param capacity   - capacity of knapsack;
+ * @param size       - functor providing item's size;
+ * @param weight     - functor providing item's weight;
+ * @param epsilon    - allowed relative error;
+ * @param arena      - arena for states, null means the heap.
+ * @return Weight of packed items, at least (1 - @p epsilon) of optimum, and
+ * upper bound of optimum.
+ */
+template <class RandomIt, class SizeFn, class WeightFn>
+ApproximateWeight approximateKnapsack(RandomIt first, RandomIt last,
+                                      uint64_t capacity, SizeFn size,
+                                      WeightFn weight, double epsilon,
+                                      Arena* arena = nullptr) {
+  if (!approximationPays(first, last, capacity, size, weight, epsilon)) {
+    uint64_t exact = autoKnapsack(first, last, capacity, size, weight, arena);
+    return {exact, exact};
+  }
+  TRACE_SCOPE("approximate knapsack", last - first);
+  double scale = profitScale(first, last, weight, epsilon);
+  ArenaScope scope(arena);
+  ScratchVector<ParetoState> front{ArenaAllocator<ParetoState>(arena)};
+  ScratchVector<ParetoState> buffer{ArenaAllocator<ParetoState>(arena)};
+  paretoFront(first, last, capacity, size, weight, front, buffer, scale);
+  uint64_t best = front.back().weight;
+  uint64_t total = 0;
+  for (RandomIt it = first; it != last; ++it) total += weight(*it);
+  uint64_t loss = static_cast<uint64_t>(std::ceil(scale * (last - first)));
+  return {best, std::min(total, best + loss)};
+}
+
+}  // namespace engines
+
+#endif  // SRC_APPROXIMATE_KNAPSACK_H_
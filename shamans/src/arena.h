@@ -0,0 +1,286 @@
+#ifndef SRC_ARENA_H_
+#define SRC_ARENA_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <vector>
+
+#include "../third_party/threadpool/threadpool.h"
+
+namespace engines {
+
+/** @brief Arena - monotonic scratch memory of one thread.
+ * Memory is bumped from blocks and released only by rewinding to a mark or
+ * by reset. Reset merges blocks into one block of their total size, so after
+ * the first call of similar size no more blocks are allocated.
+ */
+class Arena {
+ public:
+  /** @brief Mark - position in arena to rewind to.
+   */
+  struct Mark {
+    size_t block;
+    size_t offset;
+  };
+
+  Arena() : current(0), offset(0), base(0), peak(0) {}
+  Arena(Arena const&) = delete;
+  Arena& operator=(Arena const&) = delete;
+
+  /** @brief allocate - provides uninitialized memory.
+   * @param bytes       - size of memory;
+   * @param alignment   - alignment of memory, power of two.
+   * @return Pointer to memory valid until arena is rewound before it.
+   */
+  void* allocate(size_t bytes, size_t alignment) {
+    while (current < blocks.size()) {
+      char* data = blocks[current].data.get();
+      size_t start = align(data + offset, alignment) - data;
+      if (start + bytes <= blocks[current].size) {
+        offset = start + bytes;
+        peak = std::max(peak, base + offset);
+        return data + start;
+      }
+      if (current + 1 == blocks.size()) break;
+      base += blocks[current].size;
+      current++;
+      offset = 0;
+    }
+    // No block fits, so new one follows the current one.
+    if (!blocks.empty()) {
+      base += blocks[current].size;
+      current++;
+      offset = 0;
+    }
+    size_t size = std::max(bytes + alignment, 2 * capacity());
+    if (size < kMinBlock) size = kMinBlock;
+    blocks.push_back({std::unique_ptr<char[]>(new char[size]), size});
+    return allocate(bytes, alignment);
+  }
+
+  /** @brief mark - remembers current position.
+   * @return Mark of current position.
+   */
+  Mark mark() const { return {current, offset}; }
+
+  /** @brief rewind - releases memory allocated after the mark.
+   * @param position   - mark obtained from this arena since last reset.
+   */
+  void rewind(Mark position) {
+    while (current > position.block) base -= blocks[--current].size;
+    offset = position.offset;
+  }
+
+  /** @brief reset - releases all memory and merges blocks.
+   */
+  void reset() {
+    if (blocks.size() > 1) {
+      size_t size = capacity();
+      blocks.clear();
+      blocks.push_back({std::unique_ptr<char[]>(new char[size]), size});
+    }
+    current = offset = base = 0;
+  }
+
+  /** @brief trim - resets arena and frees its memory above given size.
+   * High water mark is cleared.
+   * @param bytes   - size of memory which may be kept.
+   */
+  void trim(size_t bytes) {
+    reset();
+    if (capacity() > bytes) blocks.clear();
+    peak = 0;
+  }
+
+  /** @brief highWater - largest memory used at once since last trim.
+   * @return Size in bytes.
+   */
+  size_t highWater() const { return peak; }
+
+  /** @brief capacity - memory owned by arena.
+   * @return Size in bytes.
+   */
+  size_t capacity() const {
+    size_t size = 0;
+    for (Block const& block : blocks) size += block.size;
+    return size;
+  }
+
+ private:
+  static const size_t kMinBlock = 4096;
+
+  struct Block {
+    std::unique_ptr<char[]> data;
+    size_t size;
+  };
+
+  static char* align(char* position, size_t alignment) {
+    uintptr_t address = reinterpret_cast<uintptr_t>(position);
+    return position + ((alignment - address % alignment) % alignment);
+  }
+
+  std::vector<Block> blocks;
+  size_t current;
+  size_t offset;
+  // Size of blocks before the current one.
+  size_t base;
+  size_t peak;
+};
+
+/** @brief ArenaScope - rewinds arena to position from its creation.
+ * Null arena is accepted and ignored.
+ */
+class ArenaScope {
+ public:
+  explicit ArenaScope(Arena* arenaArg)
+      : arena(arenaArg), position(arena ? arena->mark() : Arena::Mark{0, 0}) {}
+  ArenaScope(ArenaScope const&) = delete;
+  ArenaScope& operator=(ArenaScope const&) = delete;
+  ~ArenaScope() {
+    if (arena) arena->rewind(position);
+  }
+
+ private:
+  Arena* arena;
+  Arena::Mark position;
+};
+
+/** @brief ArenaAllocator - standard allocator using arena.
+ * Deallocation is no-op, memory comes back on rewind or reset. Null arena
+ * means the heap.
+ */
+template <class T>
+struct ArenaAllocator {
+  typedef T value_type;
+
+  explicit ArenaAllocator(Arena* arenaArg = nullptr) : arena(arenaArg) {}
+  template <class U>
+  ArenaAllocator(ArenaAllocator<U> const& other)  // NOLINT
+      : arena(other.arena) {}
+
+  T* allocate(size_t n) {
+    if (arena == nullptr)
+      return static_cast<T*>(::operator new(n * sizeof(T)));
+    return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
+  }
+
+  void deallocate(T* p, size_t) {
+    if (arena == nullptr) ::operator delete(p);
+  }
+
+  Arena* arena;
+};
+
+template <class T, class U>
+bool operator==(ArenaAllocator<T> const& a, ArenaAllocator<U> const& b) {
+  return a.arena == b.arena;
+}
+
+template <class T, class U>
+bool operator!=(ArenaAllocator<T> const& a, ArenaAllocator<U> const& b) {
+  return a.arena != b.arena;
+}
+
+/** @brief ScratchVector - vector living in arena (or on the heap).
+ */
+template <class T>
+using ScratchVector = std::vector<T, ArenaAllocator<T>>;
+
+/** @brief ScratchArray - fixed size array of objects which can't be moved,
+ * living in arena (or on the heap).
+ */
+template <class T>
+class ScratchArray {
+ public:
+  ScratchArray(size_t nArg, Arena* arenaArg)
+      : n(nArg), allocator(arenaArg), elements(allocator.allocate(n)) {
+    for (size_t i = 0; i < n; i++) new (elements + i) T();
+  }
+  ScratchArray(ScratchArray const&) = delete;
+  ScratchArray& operator=(ScratchArray const&) = delete;
+  ~ScratchArray() {
+    for (size_t i = 0; i < n; i++) elements[i].~T();
+    allocator.deallocate(elements, n);
+  }
+
+  T& operator[](size_t i) { return elements[i]; }
+  T* data() { return elements; }
+
+ private:
+  size_t n;
+  ArenaAllocator<T> allocator;
+  T* elements;
+};
+
+/** @brief Workspace - arenas of caller's thread and of pool's workers.
+ * Shared arena is used by threads which are not pool's workers.
+ */
+class Workspace {
+ public:
+  Workspace() : pool(nullptr), arenas(1) {}
+
+  /** @brief attach - creates arena for each worker of the pool.
+   * @param poolArg[in]   - pool whose workers use the workspace;
+   * @param workers       - number of pool's workers.
+   */
+  void attach(ThreadPool const* poolArg, uint64_t workers) {
+    pool = poolArg;
+    arenas = std::vector<Arena>(workers + 1);
+  }
+
+  /** @brief local - arena of calling thread.
+   * @return Worker's arena or shared one.
+   */
+  Arena& local() {
+    int index = pool != nullptr ? pool->workerIndex() : -1;
+    if (index < 0 || static_cast<size_t>(index) + 1 >= arenas.size())
+      return arenas[0];
+    return arenas[index + 1];
+  }
+
+  Arena& shared() { return arenas[0]; }
+
+  /** @brief reset - releases memory of all arenas, no worker can use them.
+   */
+  void reset() {
+    for (Arena& arena : arenas) arena.reset();
+  }
+
+  /** @brief highWater - high water marks, shared arena first.
+   * @return High water mark of each arena in bytes.
+   */
+  std::vector<size_t> highWater() const {
+    std::vector<size_t> result;
+    for (Arena const& arena : arenas) result.push_back(arena.highWater());
+    return result;
+  }
+
+  /** @brief trim - frees arenas' memory above given size.
+   * @param bytes   - size of memory which may be kept by each arena.
+   */
+  void trim(size_t bytes) {
+    for (Arena& arena : arenas) arena.trim(bytes);
+  }
+
+ private:
+  ThreadPool const* pool;
+  std::vector<Arena> arenas;
+};
+
+/** @brief localArena - arena of calling thread or null without workspace.
+ */
+inline Arena* localArena(Workspace* workspace) {
+  return workspace != nullptr ? &workspace->local() : nullptr;
+}
+
+/** @brief sharedArena - shared arena or null without workspace.
+ */
+inline Arena* sharedArena(Workspace* workspace) {
+  return workspace != nullptr ? &workspace->shared() : nullptr;
+}
+
+}  // namespace engines
+
+#endif  // SRC_ARENA_H_
@@ -0,0 +1,160 @@
+#ifndef SRC_CACHED_KEYS_H_
+#define SRC_CACHED_KEYS_H_
+
+#include <functional>
+#include <iterator>
+#include <type_traits>
+#include <vector>
+
+#include "../third_party/threadpool/threadpool.h"
+
+#include "./parallel.h"
+#include "./radix_sort.h"
+#include "./trace.h"
+
+/** Engines computing element's key once (decorate-sort-undecorate), so
+ * expensive comparisons are replaced by cheap comparisons of keys. Key
+ * functor must preserve elements' ordering: a < b exactly when
+ * key(a) < key(b).
+ */
+namespace engines {
+
+/** @brief Keyed - cached key of element and element's position in range.
+ */
+template <class K>
+struct Keyed {
+  K key;
+  size_t index;
+
+  bool operator<(Keyed const& other) const { return key < other.key; }
+};
+
+/** @brief SortKey - keyed elements with integer keys are radix sorted.
+ */
+template <class K>
+struct SortKey<Keyed<K>, typename std::enable_if<SortKey<K>::available>::type> {
+  static const bool available = true;
+  static uint64_t get(Keyed<K> const& keyed) {
+    return SortKey<K>::get(keyed.key);
+  }
+};
+
+namespace detail {
+template <class RandomIt, class KeyFn>
+struct CachedKey {
+  typedef typename std::decay<decltype(
+      std::declval<KeyFn>()(*std::declval<RandomIt>()))>::type type;
+};
+}  // namespace detail
+
+/** @brief cachedKeySort - sorts range comparing cached keys of elements.
+ * Keys are computed once per element, keyed positions are sorted (radix
+ * sort for integer keys) and elements are permuted at the end.
+ * @param first   - beginning of range;
+ * @param last    - end of range;
+ * @param keyFn   - functor providing element's key.
+ */
+template <class RandomIt, class KeyFn>
+void cachedKeySort(RandomIt first, RandomIt last, KeyFn keyFn) {
+  typedef typename std::iterator_traits<RandomIt>::value_type T;
+  typedef Keyed<typename detail::CachedKey<RandomIt, KeyFn>::type> Entry;
+  size_t n = last - first;
+  if (n < 2) return;
+  std::vector<Entry> keyed(n);
+  for (size_t i = 0; i < n; i++) keyed[i] = {keyFn(first[i]), i};
+  sortByKey(keyed.begin(), keyed.end(), std::less<Entry>());
+  std::vector<T> elements(first, last);
+  for (size_t i = 0; i < n; i++) first[i] = elements[keyed[i].index];
+}
+
+/** @brief parallelCachedKeySort - sorts range comparing cached keys of
+ * elements with workers from the pool. Keys are computed and elements are
+ * permuted by workers' chunks.
+ * @param pool[in, out]   - pool executing the work;
+ * @param workers         - number of workers;
+ * @param first           - beginning of range;
+ * @param last            - end of range;
+ * @param keyFn           - functor providing element's key.
+ */
+template <class RandomIt, class KeyFn>
+void parallelCachedKeySort(ThreadPool& pool, uint64_t workers, RandomIt first,
+                           RandomIt last, KeyFn keyFn) {
+  typedef typename std::iterator_traits<RandomIt>::value_type T;
+  typedef Keyed<typename detail::CachedKey<RandomIt, KeyFn>::type> Entry;
+  size_t n = last - first;
+  if (n < 2) return;
+  workers = std::max<uint64_t>(1, std::min<uint64_t>(workers, n));
+  if (workers == 1) return cachedKeySort(first, last, keyFn);
+  std::vector<size_t> bounds = chunkBounds(n, workers);
+  std::vector<Entry> keyed(n);
+  parallelChunks(pool, bounds, [&](size_t, size_t begin, size_t end) {
+    TRACE_SCOPE("compute keys", end - begin);
+    for (size_t i = begin; i < end; i++) keyed[i] = {keyFn(first[i]), i};
+  });
+  parallelSortByKey(pool, workers, keyed.begin(), keyed.end(),
+                    std::less<Entry>());
+  std::vector<T> elements(first, last);
+  parallelChunks(pool, bounds, [&](size_t, size_t begin, size_t end) {
+    TRACE_SCOPE("permute", end - begin);
+    for (size_t i = begin; i < end; i++) first[i] = elements[keyed[i].index];
+  });
+}
+
+/** @brief cachedKeyMaxElement - finds first largest element comparing keys.
+ * @param first   - beginning of range;
+ * @param last    - end of range;
+ * @param keyFn   - functor providing element's key.
+ * @return Iterator to largest element or @p last if range is empty.
+ */
+template <class RandomIt, class KeyFn>
+RandomIt cachedKeyMaxElement(RandomIt first, RandomIt last, KeyFn keyFn) {
+  typedef typename detail::CachedKey<RandomIt, KeyFn>::type K;
+  if (first == last) return last;
+  RandomIt best = first;
+  K bestKey = keyFn(*first);
+  for (RandomIt it = first + 1; it != last; ++it) {
+    K key = keyFn(*it);
+    if (bestKey < key) {
+      bestKey = key;
+      best = it;
+    }
+  }
+  return best;
+}
+
+/** @brief parallelCachedKeyMaxElement - finds first largest element comparing
+ * keys, with workers from the pool. Each worker reduces its chunk to best
+ * (key, index) pair.
+ * @param pool[in, out]   - pool executing the work;
+ * @param workers         - number of chunks;
+ * @param first           - beginning of range;
+ * @param last            - end of range;
+ * @param keyFn           - functor providing element's key.
+ * @return Iterator to largest element or @p last if range is empty.
+ */
+template <class RandomIt, class KeyFn>
+RandomIt parallelCachedKeyMaxElement(ThreadPool& pool, uint64_t workers,
+                                     RandomIt first, RandomIt last,
+                                     KeyFn keyFn) {
+  typedef Keyed<typename detail::CachedKey<RandomIt, KeyFn>::type> Entry;
+  size_t n = last - first;
+  if (n == 0) return last;
+  workers = std::max<uint64_t>(1, std::min<uint64_t>(workers, n));
+  if (workers == 1) return cachedKeyMaxElement(first, last, keyFn);
+  std::vector<Entry> best(workers);
+  parallelChunks(pool, chunkBounds(n, workers),
+                 [&](size_t chunk, size_t begin, size_t end) {
+                   TRACE_SCOPE("max key chunk", end - begin);
+                   RandomIt it = cachedKeyMaxElement(first + begin,
+                                                     first + end, keyFn);
+                   best[chunk] = {keyFn(*it), size_t(it - first)};
+                 });
+  Entry result = best[0];
+  for (uint64_t i = 1; i < workers; i++)
+    if (result < best[i]) result = best[i];
+  return first + result.index;
+}
+
+}  // namespace engines
+
+#endif  // SRC_CACHED_KEYS_H_
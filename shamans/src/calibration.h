@@ -0,0 +1,332 @@
+#ifndef SRC_CALIBRATION_H_
+#define SRC_CALIBRATION_H_
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../third_party/threadpool/threadpool.h"
+
+#include "./cached_keys.h"
+#include "./element_keys.h"
+#include "./intro_sort.h"
+#include "./knapsack.h"
+#include "./radix_sort.h"
+#include "./run_sort.h"
+#include "./selection.h"
+#include "./sort.h"
+#include "./types.h"
+
+/** Calibration of parallel work splitting. Costs of handing a task to a
+ * shaman and of processing single element are measured once per process (or
+ * loaded from tuning file named by SHAMANS_TUNING environment variable), then
+ * cost models pick number of shamans for each call. Single shaman means the
+ * work is done sequentially on caller's thread.
+ */
+namespace calibration {
+
+/** @brief Tuning - measured costs in nanoseconds.
+ * Sorts cost per element and level of merge sort, one cost per algorithm
+ * arranging sand.
+ */
+struct Tuning {
+  double taskNs = 20000;       // Handing task to a shaman and waiting for it.
+  double selectNs = 1;         // Comparing one element during selection.
+  double sortNs = 10;          // Merge sort with network sorted blocks.
+  double radixSortNs = 1;      // Radix sort on grains' sizes.
+  double cachedKeySortNs = 1;  // Sort of cached keys, then permutation.
+  double runSortNs = 10;       // Merge of natural runs.
+  double introSortNs = 10;     // In-place quicksort.
+  double knapsackNs = 2;       // Filling one cell of knapsack table.
+
+  /** @brief load - reads tuning saved by @ref save.
+   * @param path[in]   - path of tuning file.
+   * @return True if all costs were read.
+   */
+  bool load(std::string const& path) {
+    std::ifstream in(path);
+    Tuning loaded;
+    std::string name;
+    double value;
+    size_t found = 0;
+    while (in >> name >> value) {
+      if (value <= 0) return false;
+      auto field = std::find_if(
+          fields().begin(), fields().end(),
+          [&name](Field const& f) { return name == f.first; });
+      if (field == fields().end()) return false;
+      loaded.*(field->second) = value;
+      found++;
+    }
+    if (found != fields().size()) return false;
+    *this = loaded;
+    return true;
+  }
+
+  /** @brief save - writes tuning as "name value" lines.
+   * @param path[in]   - path of tuning file.
+   * @return True if file was written.
+   */
+  bool save(std::string const& path) const {
+    std::ofstream out(path);
+    for (Field const& field : fields())
+      out << field.first << " " << this->*(field.second) << "\n";
+    return static_cast<bool>(out);
+  }
+
+ private:
+  typedef std::pair<const char*, double Tuning::*> Field;
+
+  static std::vector<Field> const& fields() {
+    static const std::vector<Field> all = {
+        {"taskNs", &Tuning::taskNs},
+        {"selectNs", &Tuning::selectNs},
+        {"sortNs", &Tuning::sortNs},
+        {"radixSortNs", &Tuning::radixSortNs},
+        {"cachedKeySortNs", &Tuning::cachedKeySortNs},
+        {"runSortNs", &Tuning::runSortNs},
+        {"introSortNs", &Tuning::introSortNs},
+        {"knapsackNs", &Tuning::knapsackNs}};
+    return all;
+  }
+};
+
+/** @brief bestWorkers - finds number of workers with lowest estimated time.
+ * @param maxWorkers   - number of available workers;
+ * @param cost         - estimated time of work split among given workers.
+ * @return Number of workers between 1 and @p maxWorkers.
+ */
+template <class CostFn>
+uint64_t bestWorkers(uint64_t maxWorkers, CostFn cost) {
+  uint64_t best = 1;
+  double bestCost = cost(1);
+  for (uint64_t w = 2; w <= maxWorkers; w++) {
+    double c = cost(w);
+    if (c < bestCost) {
+      best = w;
+      bestCost = c;
+    }
+  }
+  return best;
+}
+
+/** @brief selectWorkers - number of shamans selecting from @p n elements.
+ * Each shaman scans its chunk, tasks are handed out one after another.
+ */
+inline uint64_t selectWorkers(Tuning const& tuning, uint64_t n,
+                              uint64_t maxWorkers) {
+  return bestWorkers(std::min<uint64_t>(maxWorkers, std::max<uint64_t>(1, n)),
+                     [&tuning, n](uint64_t w) {
+                       double scan = tuning.selectNs * n / w;
+                       return w == 1 ? scan : scan + w * tuning.taskNs;
+                     });
+}
+
+/** @brief sortWorkers - number of shamans sorting @p n elements.
+ * Leafs are sorted in parallel, merges of the last levels dominate.
+ * @param sortNs   - cost of sort algorithm, one of @ref Tuning's sort costs.
+ */
+inline uint64_t sortWorkers(Tuning const& tuning, double sortNs, uint64_t n,
+                            uint64_t maxWorkers) {
+  return bestWorkers(
+      std::min<uint64_t>(maxWorkers, std::max<uint64_t>(1, n / 2)),
+      [&tuning, sortNs, n](uint64_t w) {
+        double leaf = static_cast<double>(n) / w;
+        double sort = sortNs * leaf * std::log2(std::max(2.0, leaf));
+        if (w == 1) return sort;
+        return sort + 2 * sortNs * n * (1 - 1.0 / w) + 2 * w * tuning.taskNs;
+      });
+}
+
+/** @brief columnSplitNs - estimated time of knapsack table filled by
+ * @p workers shamans, each owning block of columns. Rows are pipelined
+ * through shamans, each row costs synchronization.
+ */
+inline double columnSplitNs(Tuning const& tuning, uint64_t items,
+                            uint64_t capacity, uint64_t workers) {
+  double row = tuning.knapsackNs * (capacity + 1);
+  if (workers == 1) return items * row;
+  return (items + workers - 1) * (row / workers + tuning.taskNs) +
+         workers * tuning.taskNs;
+}
+
+/** @brief knapsackWorkers - number of shamans filling knapsack table.
+ */
+inline uint64_t knapsackWorkers(Tuning const& tuning, uint64_t items,
+                                uint64_t capacity, uint64_t maxWorkers) {
+  return bestWorkers(
+      std::min<uint64_t>(maxWorkers, std::max<uint64_t>(1, capacity + 1)),
+      [&tuning, items, capacity](uint64_t w) {
+        return columnSplitNs(tuning, items, capacity, w);
+      });
+}
+
+/** @brief itemSplitNs - estimated time of knapsack solved by @p workers
+ * shamans, each owning group of items. Rows of groups are merged pairwise,
+ * all but the last merge cost half of squared row, split among shamans.
+ */
+inline double itemSplitNs(Tuning const& tuning, uint64_t items,
+                          uint64_t capacity, uint64_t workers) {
+  double columns = capacity + 1.0;
+  double rows = tuning.knapsackNs * items * columns / workers;
+  if (workers == 1) return rows;
+  double merges = tuning.knapsackNs * (workers - 2) * columns * columns / 2;
+  double levels = std::ceil(std::log2(workers));
+  return rows + merges / workers + tuning.knapsackNs * columns +
+         (levels + 1) * workers * tuning.taskNs;
+}
+
+/** @brief itemSplitWorkers - number of shamans splitting knapsack's items.
+ */
+inline uint64_t itemSplitWorkers(Tuning const& tuning, uint64_t items,
+                                 uint64_t capacity, uint64_t maxWorkers) {
+  return bestWorkers(
+      std::min<uint64_t>(maxWorkers, std::max<uint64_t>(1, items)),
+      [&tuning, items, capacity](uint64_t w) {
+        return itemSplitNs(tuning, items, capacity, w);
+      });
+}
+
+/** @brief batchWorkers - number of shamans sharing independent instances.
+ * Shamans take instances one by one, so work is balanced up to the largest
+ * instance.
+ */
+inline uint64_t batchWorkers(Tuning const& tuning, double workNs,
+                             double largestNs, uint64_t instances,
+                             uint64_t maxWorkers) {
+  return bestWorkers(
+      std::min<uint64_t>(maxWorkers, std::max<uint64_t>(1, instances)),
+      [&tuning, workNs, largestNs](uint64_t w) {
+        if (w == 1) return workNs;
+        return std::max(workNs / w, largestNs) + w * tuning.taskNs;
+      });
+}
+
+inline double elapsedNs(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::nano>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+/** @brief fastest - runs measurement few times to skip warm-up and noise.
+ * @param f   - measured function.
+ * @return Shortest time in nanoseconds.
+ */
+template <class F>
+double fastest(F f) {
+  double best = 0;
+  for (int i = 0; i < 3; i++) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    double ns = elapsedNs(start);
+    if (i == 0 || ns < best) best = ns;
+  }
+  return std::max(best, 1.0);
+}
+
+/** @brief measureSort - measures cost of sorting grains as adventures do.
+ * @param keys[in]   - sizes of sorted grains;
+ * @param sort       - sorts std::vector<GrainOfSand>.
+ * @return Cost per element and level of merge sort.
+ */
+template <class SortFn>
+double measureSort(std::vector<uint64_t> const& keys, SortFn sort) {
+  std::vector<GrainOfSand> grains(keys.size());
+  return fastest([&keys, &grains, &sort]() {
+           std::copy(keys.begin(), keys.end(), grains.begin());
+           sort(grains);
+         }) /
+         (grains.size() * std::log2(grains.size()));
+}
+
+/** @brief measure - measures costs on this machine with adventures' element
+ * types, whose comparisons dominate the costs, takes tens of milliseconds.
+ * Each sort is measured with comparator or key adventures pass to it.
+ * @return Measured tuning.
+ */
+inline Tuning measure() {
+  Tuning tuning;
+  ThreadPool pool(1);
+  const int kTasks = 64;
+  tuning.taskNs = fastest([&pool]() {
+                    for (int i = 0; i < kTasks; i++) pool.enqueue([]() {}).get();
+                  }) /
+                  kTasks;
+
+  std::vector<uint64_t> data(1 << 12);
+  uint64_t seed = 88172645463325252ull;
+  for (uint64_t& x : data) {
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    x = seed;
+  }
+  std::vector<Crystal> crystals(data.begin(), data.end());
+  volatile uint64_t sink = 0;
+  tuning.selectNs = fastest([&crystals, &sink]() {
+                      sink = engines::maxElement(crystals.begin(),
+                                                 crystals.end(),
+                                                 std::less<Crystal>())
+                                 ->getShininess();
+                    }) /
+                    crystals.size();
+
+  typedef std::vector<GrainOfSand> Grains;
+  std::vector<uint64_t> keys(data.begin(), data.begin() + data.size() / 4);
+  tuning.sortNs = measureSort(keys, [](Grains& grains) {
+    engines::mergeSort(grains.begin(), grains.end(), std::less<GrainOfSand>());
+  });
+  tuning.radixSortNs = measureSort(keys, [](Grains& grains) {
+    engines::sortByKey(grains.begin(), grains.end(), std::less<GrainOfSand>());
+  });
+  tuning.cachedKeySortNs = measureSort(keys, [](Grains& grains) {
+    engines::cachedKeySort(grains.begin(), grains.end(), GrainKey());
+  });
+  tuning.runSortNs = measureSort(keys, [](Grains& grains) {
+    engines::runSort(grains.begin(), grains.end(), std::less<GrainOfSand>());
+  });
+  tuning.introSortNs = measureSort(keys, [](Grains& grains) {
+    engines::introSort(grains.begin(), grains.end(), std::less<GrainOfSand>());
+  });
+
+  const uint64_t kItems = 16, kCapacity = 1023;
+  std::vector<Egg> eggs;
+  for (uint64_t i = 0; i < kItems; i++)
+    eggs.push_back(Egg(data[i] % 64 + 1, data[i] % 1000));
+  tuning.knapsackNs =
+      fastest([&eggs, &sink]() {
+        sink = engines::knapsack(eggs.begin(), eggs.end(), kCapacity,
+                                 [](Egg& egg) { return egg.getSize(); },
+                                 [](Egg& egg) { return egg.getWeight(); });
+      }) /
+      (kItems * (kCapacity + 1));
+  return tuning;
+}
+
+/** @brief defaultTuning - tuning shared by adventures of this process.
+ * If SHAMANS_TUNING names readable tuning file it is used, otherwise costs
+ * are measured and saved to that file (when variable is set).
+ * @return Reference to tuning.
+ */
+inline Tuning const& defaultTuning() {
+  static Tuning tuning = []() {
+    Tuning result;
+    const char* path = std::getenv("SHAMANS_TUNING");
+    if (path != nullptr && result.load(path)) return result;
+    result = measure();
+    if (path != nullptr) result.save(path);
+    return result;
+  }();
+  return tuning;
+}
+
+}  // namespace calibration
+
+#endif  // SRC_CALIBRATION_H_
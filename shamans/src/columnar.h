@@ -0,0 +1,300 @@
+#ifndef SRC_COLUMNAR_H_
+#define SRC_COLUMNAR_H_
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "../third_party/threadpool/threadpool.h"
+
+#include "./parallel.h"
+#include "./trace.h"
+
+/** Columnar files map datasets into memory instead of parsing them. File
+ * starts with @ref ColumnarHeader, then each column stores one native 64-bit
+ * integer per row: eggs have size and weight columns, grains size column and
+ * crystals shininess column.
+ */
+namespace engines {
+
+/** @brief Span - view of contiguous elements owned by someone else.
+ */
+template <class T>
+class Span {
+ public:
+  Span() : first(nullptr), count(0) {}
+
+  Span(T* data, size_t size) : first(data), count(size) {}
+
+  Span(std::vector<typename std::remove_const<T>::type>& elements)  // NOLINT
+      : first(elements.data()), count(elements.size()) {}
+
+  T* begin() const { return first; }
+  T* end() const { return first + count; }
+  T* data() const { return first; }
+  size_t size() const { return count; }
+  bool empty() const { return count == 0; }
+  T& operator[](size_t i) const { return first[i]; }
+
+ private:
+  T* first;
+  size_t count;
+};
+
+/** @brief ColumnarKind - datasets stored in columnar files.
+ */
+enum class ColumnarKind : uint32_t {
+  kEggs = 1,     // Size and weight columns.
+  kGrains = 2,   // Size column.
+  kCrystals = 3  // Shininess column.
+};
+
+/** @brief columnsOf - number of columns of dataset.
+ * @return Number of columns, 0 for unknown dataset.
+ */
+inline uint32_t columnsOf(ColumnarKind kind) {
+  switch (kind) {
+    case ColumnarKind::kEggs:
+      return 2;
+    case ColumnarKind::kGrains:
+    case ColumnarKind::kCrystals:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+/** @brief ColumnarHeader - beginning of columnar file.
+ */
+struct ColumnarHeader {
+  char magic[4];  // "SHMC"
+  uint32_t version;
+  ColumnarKind kind;
+  uint32_t columns;
+  uint64_t rows;
+};
+
+static_assert(sizeof(ColumnarHeader) == 24, "Columns must stay aligned");
+
+const char kColumnarMagic[4] = {'S', 'H', 'M', 'C'};
+const uint32_t kColumnarVersion = 1;
+
+/** @brief MappedColumns - columnar file mapped into memory.
+ * Read-only mapping is private, read-write one is shared, so writes reach
+ * the file. Mapping is advised to be read sequentially.
+ */
+class MappedColumns {
+ public:
+  /** @brief MappedColumns - maps existing file, throws std::runtime_error if
+   * it isn't a valid columnar file.
+   * @param path[in]   - path of file;
+   * @param writable   - true if columns will be modified.
+   */
+  MappedColumns(std::string const& path, bool writable)
+      : fd(-1), address(nullptr), bytes(0), writable(writable) {
+    fd = open(path.c_str(), writable ? O_RDWR : O_RDONLY);
+    if (fd < 0) throw std::runtime_error("Can't open " + path);
+    struct stat status;
+    if (fstat(fd, &status) != 0) fail("Can't stat " + path);
+    bytes = status.st_size;
+    if (bytes < sizeof(ColumnarHeader)) fail("Not a columnar file " + path);
+    map();
+    ColumnarHeader const& head = header();
+    size_t rowBytes = 8 * head.columns;
+    size_t data = bytes - sizeof(ColumnarHeader);
+    if (std::memcmp(head.magic, kColumnarMagic, sizeof(kColumnarMagic)) != 0 ||
+        head.version != kColumnarVersion || head.columns == 0 ||
+        head.columns != columnsOf(head.kind) || data % rowBytes != 0 ||
+        data / rowBytes != head.rows)
+      fail("Not a columnar file " + path);
+  }
+
+  /** @brief create - creates file of given dataset with zeroed columns and
+   * maps it for writing.
+   * @param path[in]   - path of file, existing file is replaced;
+   * @param kind       - stored dataset;
+   * @param rows       - number of rows.
+   * @return Writable mapping of the file.
+   */
+  static MappedColumns create(std::string const& path, ColumnarKind kind,
+                              uint64_t rows) {
+    if (columnsOf(kind) == 0) throw std::runtime_error("Unknown dataset");
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) throw std::runtime_error("Can't create " + path);
+    MappedColumns file(fd,
+                       sizeof(ColumnarHeader) + 8 * columnsOf(kind) * rows);
+    if (ftruncate(fd, file.bytes) != 0) file.fail("Can't resize " + path);
+    file.map();
+    ColumnarHeader& head = *static_cast<ColumnarHeader*>(file.address);
+    std::memcpy(head.magic, kColumnarMagic, sizeof(kColumnarMagic));
+    head.version = kColumnarVersion;
+    head.kind = kind;
+    head.columns = columnsOf(kind);
+    head.rows = rows;
+    return file;
+  }
+
+  MappedColumns(MappedColumns&& other)
+      : fd(other.fd),
+        address(other.address),
+        bytes(other.bytes),
+        writable(other.writable) {
+    other.fd = -1;
+    other.address = nullptr;
+  }
+
+  MappedColumns(MappedColumns const&) = delete;
+  MappedColumns& operator=(MappedColumns const&) = delete;
+  MappedColumns& operator=(MappedColumns&&) = delete;
+
+  ~MappedColumns() { release(); }
+
+  ColumnarKind kind() const { return header().kind; }
+  uint64_t rows() const { return header().rows; }
+
+  /** @brief column - provides read-only view of column.
+   * @param i   - number of column.
+   * @return Values of column, one per row.
+   */
+  Span<uint64_t const> column(uint32_t i) const {
+    check(i);
+    return Span<uint64_t const>(columnData(i), rows());
+  }
+
+  /** @brief mutableColumn - provides writable view of column, throws
+   * std::runtime_error if file is mapped read-only.
+   * @param i   - number of column.
+   * @return Values of column, one per row.
+   */
+  Span<uint64_t> mutableColumn(uint32_t i) {
+    check(i);
+    if (!writable) throw std::runtime_error("Column is read-only");
+    return Span<uint64_t>(columnData(i), rows());
+  }
+
+  /** @brief touch - faults all pages in, each worker its chunk of them, so
+   * first pass over columns doesn't wait for the disk page by page.
+   * @param pool[in, out]   - pool executing the work;
+   * @param workers         - number of chunks.
+   */
+  void touch(ThreadPool& pool, uint64_t workers) {
+    TRACE_SCOPE("touch columns", bytes);
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t pages = (bytes + page - 1) / page;
+    workers = std::max<uint64_t>(1, std::min<uint64_t>(workers, pages));
+    char const* base = static_cast<char const*>(address);
+    parallelChunks(pool, chunkBounds(pages, workers),
+                   [base, page](size_t, size_t begin, size_t end) {
+                     volatile char sink = 0;
+                     for (size_t i = begin; i < end; i++)
+                       sink = sink + base[i * page];
+                   });
+  }
+
+ private:
+  MappedColumns(int fd, size_t bytes)
+      : fd(fd), address(nullptr), bytes(bytes), writable(true) {}
+
+  void map() {
+    address = mmap(nullptr, bytes,
+                   writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                   writable ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+    if (address == MAP_FAILED) {
+      address = nullptr;
+      fail("Can't map columnar file");
+    }
+    madvise(address, bytes, MADV_SEQUENTIAL);
+  }
+
+  void release() {
+    if (address != nullptr) munmap(address, bytes);
+    if (fd >= 0) close(fd);
+    address = nullptr;
+    fd = -1;
+  }
+
+  [[noreturn]] void fail(std::string const& message) {
+    release();
+    throw std::runtime_error(message);
+  }
+
+  void check(uint32_t i) const {
+    if (i >= header().columns) throw std::out_of_range("No such column");
+  }
+
+  ColumnarHeader const& header() const {
+    return *static_cast<ColumnarHeader const*>(address);
+  }
+
+  uint64_t* columnData(uint32_t i) const {
+    char* base = static_cast<char*>(address) + sizeof(ColumnarHeader);
+    return reinterpret_cast<uint64_t*>(base) + i * rows();
+  }
+
+  int fd;
+  void* address;
+  size_t bytes;
+  bool writable;
+};
+
+/** @brief columnView - views column as elements holding single 64-bit
+ * integer, like grains or crystals, without copying.
+ * @param file[in]   - mapped file;
+ * @param i          - number of column.
+ * @return Read-only elements of column.
+ */
+template <class T>
+Span<T const> columnView(MappedColumns const& file, uint32_t i) {
+  static_assert(std::is_standard_layout<T>::value && sizeof(T) == 8,
+                "Element must be a single 64-bit integer");
+  Span<uint64_t const> values = file.column(i);
+  return Span<T const>(reinterpret_cast<T const*>(values.data()),
+                       values.size());
+}
+
+/** @brief mutableColumnView - views column as writable elements holding
+ * single 64-bit integer, see @ref columnView.
+ * @param file[in, out]   - file mapped for writing;
+ * @param i               - number of column.
+ * @return Writable elements of column.
+ */
+template <class T>
+Span<T> mutableColumnView(MappedColumns& file, uint32_t i) {
+  static_assert(std::is_standard_layout<T>::value && sizeof(T) == 8,
+                "Element must be a single 64-bit integer");
+  Span<uint64_t> values = file.mutableColumn(i);
+  return Span<T>(reinterpret_cast<T*>(values.data()), values.size());
+}
+
+/** @brief ColumnSize - functor providing size of item given by reference to
+ * its value in size column.
+ */
+struct ColumnSize {
+  uint64_t operator()(uint64_t const& size) const { return size; }
+};
+
+/** @brief ColumnWeight - functor providing weight of item given by
+ * reference to its value in size column, weight is in the same row of
+ * weight column.
+ */
+struct ColumnWeight {
+  uint64_t const* sizes;
+  uint64_t const* weights;
+
+  uint64_t operator()(uint64_t const& size) const {
+    return weights[&size - sizes];
+  }
+};
+
+}  // namespace engines
+
+#endif  // SRC_COLUMNAR_H_
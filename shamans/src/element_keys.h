@@ -0,0 +1,38 @@
+#ifndef SRC_ELEMENT_KEYS_H_
+#define SRC_ELEMENT_KEYS_H_
+
+#include <cstdint>
+
+#include "./sorting_network.h"
+#include "./types.h"
+
+/** Integer keys of adventures' elements. Keys let engines order grains and
+ * crystals without calling their costly comparison operators.
+ */
+namespace engines {
+/** @brief SortKey - grains are ordered by their sizes.
+ */
+template <>
+struct SortKey<GrainOfSand> {
+  static const bool available = true;
+  static uint64_t get(GrainOfSand const& grain) { return grain.getSize(); }
+};
+}  // namespace engines
+
+/** @brief GrainKey - functor providing grain's key to cached key engines.
+ */
+struct GrainKey {
+  uint64_t operator()(GrainOfSand const& grain) const {
+    return grain.getSize();
+  }
+};
+
+/** @brief CrystalKey - functor providing crystal's key to cached key engines.
+ */
+struct CrystalKey {
+  uint64_t operator()(Crystal const& crystal) const {
+    return crystal.getShininess();
+  }
+};
+
+#endif  // SRC_ELEMENT_KEYS_H_
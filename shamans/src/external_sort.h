@@ -0,0 +1,379 @@
+#ifndef SRC_EXTERNAL_SORT_H_
+#define SRC_EXTERNAL_SORT_H_
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "../third_party/threadpool/threadpool.h"
+
+#include "./loser_tree.h"
+#include "./trace.h"
+
+/** Engines sorting files larger than memory. Files hold elements in their
+ * in-memory layout, one after another, so elements must be standard layout
+ * types which own no memory.
+ */
+namespace engines {
+
+// Blocks read or written by merge are at least this large, runs are merged
+// in several passes if memory can't hold two such blocks of every run.
+const size_t kMinMergeBlockBytes = 1 << 16;
+// Runs merged at once never exceed this number, whatever the memory.
+const size_t kMaxFanIn = 1024;
+
+/** @brief FileCloser - deleter closing C file.
+ */
+struct FileCloser {
+  void operator()(std::FILE* file) const { std::fclose(file); }
+};
+
+typedef std::unique_ptr<std::FILE, FileCloser> File;
+
+/** @brief openFile - opens file or throws std::runtime_error.
+ * @param path[in]   - path of file;
+ * @param mode[in]   - mode passed to fopen.
+ * @return Opened file.
+ */
+inline File openFile(std::string const& path, const char* mode) {
+  File file(std::fopen(path.c_str(), mode));
+  if (!file) throw std::runtime_error("Can't open " + path);
+  return file;
+}
+
+/** @brief scratchFile - creates anonymous file for sorted run.
+ * File is removed from directory at once, so it disappears when closed.
+ * @param directory[in]   - directory of file.
+ * @return Opened file.
+ */
+inline File scratchFile(std::string const& directory) {
+  std::string path = directory + "/sandRunXXXXXX";
+  int fd = mkstemp(&path[0]);
+  if (fd < 0) throw std::runtime_error("Can't create file in " + directory);
+  unlink(path.c_str());
+  File file(fdopen(fd, "w+b"));
+  if (!file) {
+    close(fd);
+    throw std::runtime_error("Can't open file in " + directory);
+  }
+  return file;
+}
+
+/** @brief readBlock - reads elements from current position of file.
+ * @param file[in, out]   - read file;
+ * @param data[out]       - read elements;
+ * @param count           - maximal number of elements.
+ * @return Number of read elements, less than @p count at the end of file.
+ */
+template <class T>
+size_t readBlock(std::FILE* file, T* data, size_t count) {
+  TRACE_SCOPE("read block", count);
+  size_t read = std::fread(data, sizeof(T), count, file);
+  if (read < count && std::ferror(file))
+    throw std::runtime_error("Can't read sorted file");
+  return read;
+}
+
+/** @brief writeBlock - writes elements at current position of file.
+ * @param file[in, out]   - written file;
+ * @param data[in]        - written elements;
+ * @param count           - number of elements.
+ */
+template <class T>
+void writeBlock(std::FILE* file, T const* data, size_t count) {
+  TRACE_SCOPE("write block", count);
+  if (std::fwrite(data, sizeof(T), count, file) != count)
+    throw std::runtime_error("Can't write sorted file");
+}
+
+/** @brief runAsync - runs function on the pool or, without pool, when its
+ * result is requested.
+ * @param pool   - pool executing the function, may be null;
+ * @param f      - function without arguments.
+ * @return Future result of function.
+ */
+template <class F>
+auto runAsync(ThreadPool* pool, F f)
+    -> std::future<typename std::result_of<F()>::type> {
+  if (pool == nullptr) return std::async(std::launch::deferred, f);
+  return pool->enqueue(f);
+}
+
+/** @brief maxOpenRuns - number of runs' files which may be open at once,
+ * half of process's limit of open files is left to the rest of process.
+ * @return Number of files, at least 2.
+ */
+inline size_t maxOpenRuns() {
+  size_t files = 2 * kMaxFanIn;
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY)
+    files = std::min<size_t>(files, limit.rlim_cur);
+  return std::max<size_t>(2, files / 2);
+}
+
+/** @brief RunReader - reads sorted run block by block. Next block is read
+ * on the pool while current one is merged.
+ */
+template <class T>
+class RunReader {
+ public:
+  RunReader(ThreadPool* pool, std::FILE* file, size_t block)
+      : pool(pool), file(file), current(block), next(block) {
+    std::rewind(file);
+    fetch();
+    advance();
+  }
+
+  RunReader(RunReader const&) = delete;
+  RunReader& operator=(RunReader const&) = delete;
+
+  ~RunReader() {
+    if (pending.valid()) pending.wait();
+  }
+
+  bool exhausted() const { return position == size; }
+
+  T const& head() const { return current[position]; }
+
+  void pop() {
+    if (++position == size) advance();
+  }
+
+ private:
+  void fetch() {
+    T* data = next.data();
+    size_t count = next.size();
+    std::FILE* source = file;
+    pending = runAsync(pool, [source, data, count]() {
+      return readBlock(source, data, count);
+    });
+  }
+
+  void advance() {
+    size = pending.get();
+    position = 0;
+    current.swap(next);
+    if (size != 0) fetch();
+  }
+
+  ThreadPool* pool;
+  std::FILE* file;
+  std::vector<T> current;
+  std::vector<T> next;
+  std::future<size_t> pending;
+  size_t position = 0;
+  size_t size = 0;
+};
+
+/** @brief RunWriter - writes elements block by block. Full block is written
+ * on the pool while the next one is filled.
+ */
+template <class T>
+class RunWriter {
+ public:
+  RunWriter(ThreadPool* pool, std::FILE* file, size_t block)
+      : pool(pool), file(file), block(block) {
+    buffer.reserve(block);
+    writing.reserve(block);
+  }
+
+  RunWriter(RunWriter const&) = delete;
+  RunWriter& operator=(RunWriter const&) = delete;
+
+  ~RunWriter() {
+    if (pending.valid()) pending.wait();
+  }
+
+  void push(T const& element) {
+    buffer.push_back(element);
+    if (buffer.size() == block) flush();
+  }
+
+  /** @brief finish - writes the rest of elements and waits for writes.
+   */
+  void finish() {
+    flush();
+    pending.get();
+    if (std::fflush(file) != 0)
+      throw std::runtime_error("Can't write sorted file");
+  }
+
+ private:
+  void flush() {
+    if (pending.valid()) pending.get();
+    writing.swap(buffer);
+    buffer.clear();
+    T const* data = writing.data();
+    size_t count = writing.size();
+    std::FILE* target = file;
+    pending = runAsync(pool, [target, data, count]() {
+      writeBlock(target, data, count);
+    });
+  }
+
+  ThreadPool* pool;
+  std::FILE* file;
+  size_t block;
+  std::vector<T> buffer;
+  std::vector<T> writing;
+  std::future<void> pending;
+};
+
+/** @brief mergeRuns - merges sorted runs with loser tree, stable.
+ * Runs are read ahead and output is written from a second buffer on the
+ * pool, so I/O overlaps merging.
+ * @param pool       - pool doing I/O, null means the caller;
+ * @param runs[in]   - sorted runs, earlier run wins ties;
+ * @param out        - file receiving merged elements;
+ * @param block      - number of elements in each buffer;
+ * @param comp       - strict weak ordering of elements.
+ */
+template <class T, class Compare>
+void mergeRuns(ThreadPool* pool, std::vector<File> const& runs,
+               std::FILE* out, size_t block, Compare comp) {
+  TRACE_SCOPE("merge runs", runs.size());
+  if (runs.empty()) return;
+  std::vector<std::unique_ptr<RunReader<T>>> readers;
+  for (File const& run : runs)
+    readers.emplace_back(new RunReader<T>(pool, run.get(), block));
+  // Exhausted runs lose every match.
+  auto beats = [&readers, &comp](size_t a, size_t b) {
+    if (readers[a]->exhausted()) return false;
+    if (readers[b]->exhausted()) return true;
+    T const& x = readers[a]->head();
+    T const& y = readers[b]->head();
+    return comp(x, y) || (a < b && !comp(y, x));
+  };
+  LoserTree tree(readers.size(), beats);
+  RunWriter<T> writer(pool, out, block);
+  while (!readers[tree.winner()]->exhausted()) {
+    RunReader<T>& reader = *readers[tree.winner()];
+    writer.push(reader.head());
+    reader.pop();
+    tree.replay(beats);
+  }
+  writer.finish();
+}
+
+/** @brief mergePass - merges each group of @p fanIn runs into single run.
+ * @param pool             - pool doing I/O, null means the caller;
+ * @param runs[in, out]    - sorted runs, replaced by merged ones;
+ * @param fanIn            - number of runs in group, at least 2;
+ * @param memory           - bytes of memory for blocks;
+ * @param directory[in]    - directory of runs' files;
+ * @param comp             - strict weak ordering of elements.
+ */
+template <class T, class Compare>
+void mergePass(ThreadPool* pool, std::vector<File>& runs, size_t fanIn,
+               size_t memory, std::string const& directory, Compare comp) {
+  TRACE_SCOPE("merge pass", runs.size());
+  std::vector<File> merged;
+  for (size_t i = 0; i < runs.size(); i += fanIn) {
+    std::vector<File> group;
+    for (size_t j = i; j < std::min(runs.size(), i + fanIn); j++)
+      group.push_back(std::move(runs[j]));
+    size_t block =
+        std::max<size_t>(1, memory / (2 * (group.size() + 1)) / sizeof(T));
+    merged.push_back(scratchFile(directory));
+    mergeRuns<T>(pool, group, merged.back().get(), block, comp);
+  }
+  runs.swap(merged);
+}
+
+/** @brief externalSort - sorts file larger than memory.
+ * Input is read in chunks of a quarter of memory, leaving room for
+ * @p sortChunk's scratch. While one chunk is sorted the next one is read and
+ * the previous one is written as sorted run on the pool. Runs are then
+ * merged with loser tree (@ref mergeRuns), in several passes when memory
+ * can't hold blocks of all runs. Runs' open files are kept below the
+ * process's limit (@ref maxOpenRuns) by merging them while chunks are read.
+ * @param pool            - pool doing I/O, null means the caller;
+ * @param input[in]       - path of unsorted file;
+ * @param output[in]      - path of sorted file, may equal @p input;
+ * @param memory          - bytes of memory for elements;
+ * @param directory[in]   - directory of runs' files;
+ * @param comp            - strict weak ordering of elements;
+ * @param sortChunk       - sorts std::vector<T> in memory consistently with
+ *                          @p comp.
+ * @return Number of sorted elements.
+ */
+template <class T, class Compare, class SortFn>
+uint64_t externalSort(ThreadPool* pool, std::string const& input,
+                      std::string const& output, size_t memory,
+                      std::string const& directory, Compare comp,
+                      SortFn sortChunk) {
+  static_assert(std::is_standard_layout<T>::value,
+                "Sorted elements are stored as their bytes");
+  TRACE_SCOPE("external sort", memory);
+  size_t chunk = std::max<size_t>(1, memory / 4 / sizeof(T));
+  // Each merged run and output need two blocks.
+  size_t blocks = memory / kMinMergeBlockBytes / 2;
+  size_t openRuns = maxOpenRuns();
+  size_t fanIn = std::min(std::min(blocks > 3 ? blocks - 1 : 2, kMaxFanIn),
+                          openRuns);
+  std::vector<File> runs;
+  uint64_t total = 0;
+  {
+    File in = openFile(input, "rb");
+    std::FILE* source = in.get();
+    std::vector<T> reading(chunk), sorting, writing;
+    std::future<size_t> read = runAsync(
+        pool, [source, &reading]() {
+          return readBlock(source, reading.data(), reading.size());
+        });
+    std::future<void> written;
+    // Pending I/O must not outlive buffers when sorting throws.
+    struct Pending {
+      std::future<size_t>& read;
+      std::future<void>& written;
+      ~Pending() {
+        if (read.valid()) read.wait();
+        if (written.valid()) written.wait();
+      }
+    } pending{read, written};
+    while (size_t n = read.get()) {
+      total += n;
+      sorting.swap(reading);
+      sorting.resize(n);
+      reading.resize(chunk);
+      read = runAsync(pool, [source, &reading]() {
+        return readBlock(source, reading.data(), reading.size());
+      });
+      {
+        TRACE_SCOPE("sort chunk", n);
+        sortChunk(sorting);
+      }
+      if (written.valid()) written.get();
+      // Chunks being read and sorted leave a quarter of memory to merge.
+      if (runs.size() == openRuns)
+        mergePass<T>(pool, runs, fanIn, memory / 4, directory, comp);
+      writing.swap(sorting);
+      runs.push_back(scratchFile(directory));
+      std::FILE* run = runs.back().get();
+      written = runAsync(pool, [run, &writing]() {
+        writeBlock(run, writing.data(), writing.size());
+      });
+    }
+    if (written.valid()) written.get();
+  }
+  while (runs.size() > fanIn)
+    mergePass<T>(pool, runs, fanIn, memory, directory, comp);
+  File out = openFile(output, "wb");
+  size_t block =
+      std::max<size_t>(1, memory / (2 * (runs.size() + 1)) / sizeof(T));
+  mergeRuns<T>(pool, runs, out.get(), block, comp);
+  return total;
+}
+
+}  // namespace engines
+
+#endif  // SRC_EXTERNAL_SORT_H_
@@ -0,0 +1,339 @@
+#ifndef SRC_INTRO_SORT_H_
+#define SRC_INTRO_SORT_H_
+
+#include <algorithm>
+#include <future>
+#include <iterator>
+#include <vector>
+
+#include "../third_party/threadpool/threadpool.h"
+
+#include "./parallel.h"
+#include "./trace.h"
+
+namespace engines {
+
+// Ranges up to this size are sorted by insertion.
+const size_t kInsertionSortSize = 16;
+// Elements classified at once by block partition, offsets fit in a byte.
+const size_t kPartitionBlock = 64;
+// Ranges above this size get pseudo-median of nine elements as pivot.
+const size_t kNintherSize = 128;
+
+/** @brief sort3 - orders three elements.
+ */
+template <class RandomIt, class Compare>
+void sort3(RandomIt a, RandomIt b, RandomIt c, Compare comp) {
+  if (comp(*b, *a)) std::iter_swap(a, b);
+  if (comp(*c, *b)) std::iter_swap(b, c);
+  if (comp(*b, *a)) std::iter_swap(a, b);
+}
+
+/** @brief choosePivot - moves pivot to the first position.
+ * Pivot is median of three elements or, for large ranges, median of medians
+ * of three triples (ninther).
+ * @param first   - beginning of range, at least 3 elements;
+ * @param last    - end of range;
+ * @param comp    - strict weak ordering of elements.
+ */
+template <class RandomIt, class Compare>
+void choosePivot(RandomIt first, RandomIt last, Compare comp) {
+  size_t n = last - first;
+  RandomIt middle = first + n / 2;
+  if (n > kNintherSize) {
+    sort3(first, middle, last - 1, comp);
+    sort3(first + 1, middle - 1, last - 2, comp);
+    sort3(first + 2, middle + 1, last - 3, comp);
+    sort3(middle - 1, middle, middle + 1, comp);
+  } else {
+    sort3(first, middle, last - 1, comp);
+  }
+  std::iter_swap(first, middle);
+}
+
+/** @brief partitionBlocks - partitions range around pivot in place.
+ * Blocks from both ends are classified without branches into offsets of
+ * misplaced elements, then misplaced elements are swapped pairwise. Remainder
+ * smaller than two blocks is partitioned element by element.
+ * @param first   - beginning of range;
+ * @param last    - end of range;
+ * @param pivot   - pivot value, not element of the range;
+ * @param comp    - strict weak ordering of elements.
+ * @return First element not less than pivot.
+ */
+template <class RandomIt, class T, class Compare>
+RandomIt partitionBlocks(RandomIt first, RandomIt last, T const& pivot,
+                         Compare comp) {
+  unsigned char left[kPartitionBlock], right[kPartitionBlock];
+  size_t leftCount = 0, rightCount = 0, leftStart = 0, rightStart = 0;
+  // Elements before first are less than pivot, from last on not less.
+  while (static_cast<size_t>(last - first) > 2 * kPartitionBlock) {
+    if (leftCount == 0) {
+      leftStart = 0;
+      for (size_t i = 0; i < kPartitionBlock; i++) {
+        left[leftCount] = static_cast<unsigned char>(i);
+        leftCount += !comp(first[i], pivot);
+      }
+    }
+    if (rightCount == 0) {
+      rightStart = 0;
+      for (size_t i = 0; i < kPartitionBlock; i++) {
+        right[rightCount] = static_cast<unsigned char>(i);
+        rightCount += comp(*(last - 1 - i), pivot);
+      }
+    }
+    size_t swaps = std::min(leftCount, rightCount);
+    for (size_t k = 0; k < swaps; k++)
+      std::iter_swap(first + left[leftStart + k],
+                     last - 1 - right[rightStart + k]);
+    leftCount -= swaps;
+    rightCount -= swaps;
+    leftStart += swaps;
+    rightStart += swaps;
+    if (leftCount == 0) first += kPartitionBlock;
+    if (rightCount == 0) last -= kPartitionBlock;
+  }
+  // Partly classified block is classified again.
+  return std::partition(first, last,
+                        [&comp, &pivot](T const& x) { return comp(x, pivot); });
+}
+
+/** @brief partitionAroundFirst - partitions range around its first element.
+ * @param first   - beginning of range, holds pivot;
+ * @param last    - end of range;
+ * @param comp    - strict weak ordering of elements.
+ * @return Final position of pivot, elements before are less than it.
+ */
+template <class RandomIt, class Compare>
+RandomIt partitionAroundFirst(RandomIt first, RandomIt last, Compare comp) {
+  typedef typename std::iterator_traits<RandomIt>::value_type T;
+  T pivot = *first;
+  RandomIt middle = partitionBlocks(first + 1, last, pivot, comp) - 1;
+  std::iter_swap(first, middle);
+  return middle;
+}
+
+/** @brief insertionSort - sorts small range.
+ */
+template <class RandomIt, class Compare>
+void insertionSort(RandomIt first, RandomIt last, Compare comp) {
+  if (first == last) return;
+  for (RandomIt it = first + 1; it != last; ++it)
+    std::rotate(std::upper_bound(first, it, *it, comp), it, it + 1);
+}
+
+/** @brief introSortLoop - quicksort recursing into smaller part only, so
+ * stack has O(log n) frames.
+ * @param first      - beginning of range;
+ * @param last       - end of range;
+ * @param comp       - strict weak ordering of elements;
+ * @param depth      - partitions left before switching to heapsort;
+ * @param leftmost   - false if element before range is not greater than
+ *                     any element of range.
+ */
+template <class RandomIt, class Compare>
+void introSortLoop(RandomIt first, RandomIt last, Compare comp, int depth,
+                   bool leftmost) {
+  typedef typename std::iterator_traits<RandomIt>::value_type T;
+  while (static_cast<size_t>(last - first) > kInsertionSortSize) {
+    if (depth-- == 0) {
+      std::make_heap(first, last, comp);
+      std::sort_heap(first, last, comp);
+      return;
+    }
+    choosePivot(first, last, comp);
+    // Pivot equal to element before range is the smallest one, elements
+    // equal to it are already in place.
+    if (!leftmost && !comp(*(first - 1), *first)) {
+      T pivot = *first;
+      first = std::partition(first, last, [&comp, &pivot](T const& x) {
+        return !comp(pivot, x);
+      });
+      continue;
+    }
+    RandomIt middle = partitionAroundFirst(first, last, comp);
+    if (middle - first < last - middle) {
+      introSortLoop(first, middle, comp, depth, leftmost);
+      first = middle + 1;
+      leftmost = false;
+    } else {
+      introSortLoop(middle + 1, last, comp, depth, false);
+      last = middle;
+    }
+  }
+  insertionSort(first, last, comp);
+}
+
+/** @brief depthLimit - partitions allowed before heapsort, 2 log2 n.
+ */
+inline int depthLimit(size_t n) {
+  int depth = 0;
+  while (n > 1) {
+    n >>= 1;
+    depth += 2;
+  }
+  return depth;
+}
+
+/** @brief introSort - sorts given range sequentially in place.
+ * Quicksort with block partition, heapsort when partitions are too
+ * unbalanced, so O(n log n) time and O(log n) extra memory.
+ * @param first   - beginning of range;
+ * @param last    - end of range;
+ * @param comp    - strict weak ordering of elements.
+ */
+template <class RandomIt, class Compare>
+void introSort(RandomIt first, RandomIt last, Compare comp) {
+  TRACE_SCOPE("intro sort", last - first);
+  introSortLoop(first, last, comp, depthLimit(last - first), true);
+}
+
+/** @brief parallelPartitionBlocks - partitions range around pivot with
+ * workers from the pool. Each worker partitions its chunk, then elements
+ * not less than pivot before the split point are swapped with smaller
+ * elements after it.
+ * @param pool[in, out]   - pool executing the work;
+ * @param workers         - number of chunks;
+ * @param first           - beginning of range;
+ * @param last            - end of range;
+ * @param pivot           - pivot value, not element of the range;
+ * @param comp            - strict weak ordering of elements.
+ * @return First element not less than pivot.
+ */
+template <class RandomIt, class T, class Compare>
+RandomIt parallelPartitionBlocks(ThreadPool& pool, uint64_t workers,
+                                 RandomIt first, RandomIt last,
+                                 T const& pivot, Compare comp) {
+  TRACE_SCOPE("parallel partition", last - first);
+  std::vector<size_t> bounds = chunkBounds(last - first, workers);
+  std::vector<size_t> splits(workers);
+  parallelChunks(pool, bounds,
+                 [first, comp, &pivot, &splits](size_t chunk, size_t b,
+                                                size_t e) {
+                   splits[chunk] =
+                       partitionBlocks(first + b, first + e, pivot, comp) -
+                       first;
+                 });
+  size_t split = 0;
+  for (size_t i = 0; i < workers; i++) split += splits[i] - bounds[i];
+  // Large elements before split are swapped with small ones after it, chunk
+  // by chunk. Chunk i has large elements from largeFrom[i] and small ones up
+  // to splits[i] from smallFrom[i].
+  std::vector<size_t> largeFrom(splits), smallFrom(bounds);
+  size_t large = 0, small = 0;
+  while (true) {
+    while (large < workers &&
+           std::min(bounds[large + 1], split) <= largeFrom[large])
+      large++;
+    while (small < workers &&
+           std::max(smallFrom[small], split) >= splits[small])
+      small++;
+    if (large == workers || small == workers) break;
+    size_t from = largeFrom[large];
+    size_t to = std::max(smallFrom[small], split);
+    size_t count = std::min(std::min(bounds[large + 1], split) - from,
+                            splits[small] - to);
+    std::swap_ranges(first + from, first + from + count, first + to);
+    largeFrom[large] += count;
+    smallFrom[small] = to + count;
+  }
+  return first + split;
+}
+
+/** @brief parallelPartition - partitions range around its first element
+ * with workers from the pool, see @ref parallelPartitionBlocks.
+ * @param pool[in, out]   - pool executing the work;
+ * @param workers         - number of chunks;
+ * @param first           - beginning of range, holds pivot;
+ * @param last            - end of range;
+ * @param comp            - strict weak ordering of elements.
+ * @return Final position of pivot, elements before are less than it.
+ */
+template <class RandomIt, class Compare>
+RandomIt parallelPartition(ThreadPool& pool, uint64_t workers, RandomIt first,
+                           RandomIt last, Compare comp) {
+  typedef typename std::iterator_traits<RandomIt>::value_type T;
+  T pivot = *first;
+  RandomIt middle =
+      parallelPartitionBlocks(pool, workers, first + 1, last, pivot, comp) - 1;
+  std::iter_swap(first, middle);
+  return middle;
+}
+
+/** @brief parallelIntroSort - sorts given range in place with workers from
+ * the pool. Large ranges are partitioned by all their workers, workers are
+ * split between parts by their sizes. Elements equal to the smallest pivot
+ * are gathered after it, so repeated keys keep ranges partitioned by all
+ * workers. Ranges with single worker, or after unbalanced partition, are
+ * sorted by @ref introSort. Extra memory is O(log n) per worker. Single
+ * worker sorts on caller's thread.
+ * @param pool[in, out]   - pool executing the work;
+ * @param workers         - number of workers;
+ * @param first           - beginning of range;
+ * @param last            - end of range;
+ * @param comp            - strict weak ordering of elements.
+ */
+template <class RandomIt, class Compare>
+void parallelIntroSort(ThreadPool& pool, uint64_t workers, RandomIt first,
+                       RandomIt last, Compare comp) {
+  typedef typename std::iterator_traits<RandomIt>::value_type T;
+  struct Job {
+    RandomIt first;
+    RandomIt last;
+    uint64_t workers;
+  };
+  size_t n = last - first;
+  if (workers <= 1 || n <= kNintherSize)
+    return introSort(first, last, comp);
+  std::vector<Job> jobs{{first, last, workers}}, leafs;
+  while (!jobs.empty()) {
+    Job job = jobs.back();
+    jobs.pop_back();
+    size_t size = job.last - job.first;
+    if (job.workers <= 1 || size <= kNintherSize) {
+      leafs.push_back(job);
+      continue;
+    }
+    choosePivot(job.first, job.last, comp);
+    RandomIt middle =
+        parallelPartition(pool, job.workers, job.first, job.last, comp);
+    size_t left = middle - job.first, right = job.last - middle - 1;
+    if (left < size / 16) {
+      // Pivot is the smallest key, elements equal to it are in place once
+      // gathered after it. Many such elements make the rest small enough.
+      T pivot = *middle;
+      RandomIt rest = parallelPartitionBlocks(
+          pool, job.workers, middle + 1, job.last, pivot,
+          [comp](T const& x, T const& y) { return !comp(y, x); });
+      leafs.push_back({job.first, middle, 1});
+      jobs.push_back({rest, job.last,
+                      static_cast<size_t>(rest - middle) < size / 16
+                          ? 1
+                          : job.workers});
+      continue;
+    }
+    // Unbalanced part would be partitioned again with little progress.
+    if (right < size / 16) {
+      leafs.push_back({job.first, middle, 1});
+      leafs.push_back({middle + 1, job.last, 1});
+      continue;
+    }
+    uint64_t leftWorkers = std::max<uint64_t>(
+        1, std::min<uint64_t>(job.workers - 1,
+                              (job.workers * left + size / 2) / size));
+    jobs.push_back({job.first, middle, leftWorkers});
+    jobs.push_back({middle + 1, job.last, job.workers - leftWorkers});
+  }
+  std::vector<std::future<void>> done;
+  for (Job const& leaf : leafs) {
+    TRACE_INSTANT("spawn intro sort", leaf.last - leaf.first);
+    RandomIt l = leaf.first, r = leaf.last;
+    done.push_back(pool.enqueue([l, r, comp]() { introSort(l, r, comp); }));
+  }
+  TRACE_SCOPE("wait intro sort", n);
+  for (auto& future : done) future.get();
+}
+
+}  // namespace engines
+
+#endif  // SRC_INTRO_SORT_H_
@@ -0,0 +1,291 @@
+#ifndef SRC_KNAPSACK_H_
+#define SRC_KNAPSACK_H_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <limits>
+#include <mutex>
+#include <vector>
+
+#include "../third_party/threadpool/threadpool.h"
+
+#include "./arena.h"
+#include "./trace.h"
+
+namespace engines {
+
+/** @brief knapsackRow - fills columns of knapsack table's row.
+ * Cell j holds maximum weight of considered items not exceeding size j. Row 0
+ * is zero, so each row is nondecreasing and cell doesn't need maximum with
+ * its left neighbour. Columns below item's size are copied, the rest is
+ * maximum of two slices of previous row, without branches or dependencies
+ * between columns, so compiler can vectorize both loops. Narrower cells put
+ * more columns into each vector.
+ * @param prev[in]   - previous row;
+ * @param row[out]   - filled row;
+ * @param beg        - index of first column;
+ * @param end        - index of last column;
+ * @param itemSize   - size of row's item;
+ * @param itemWeight - weight of row's item.
+ */
+template <class Cell>
+void knapsackRow(Cell const* __restrict prev, Cell* __restrict row,
+                 uint64_t beg, uint64_t end, uint64_t itemSize,
+                 Cell itemWeight) {
+  uint64_t split = std::min(std::max(beg, itemSize), end + 1);
+  for (uint64_t j = beg; j < split; j++) row[j] = prev[j];
+  for (uint64_t j = split; j <= end; j++) {
+    Cell taken = prev[j - itemSize] + itemWeight;
+    row[j] = prev[j] < taken ? taken : prev[j];
+  }
+}
+
+/** @brief ItemColumns - sizes and weights of items in separate arrays.
+ * Items are staged once before the table is filled, so size and weight
+ * functors are not called by each row or each worker.
+ */
+struct ItemColumns {
+  explicit ItemColumns(Arena* arena)
+      : sizes(ArenaAllocator<uint64_t>(arena)),
+        weights(ArenaAllocator<uint64_t>(arena)) {}
+
+  /** @brief stage - reads size and weight of each item.
+   * @param first    - beginning of items' range;
+   * @param last     - end of items' range;
+   * @param size     - functor providing item's size;
+   * @param weight   - functor providing item's weight.
+   */
+  template <class RandomIt, class SizeFn, class WeightFn>
+  void stage(RandomIt first, RandomIt last, SizeFn size, WeightFn weight) {
+    sizes.clear();
+    weights.clear();
+    sizes.reserve(last - first);
+    weights.reserve(last - first);
+    for (RandomIt it = first; it != last; ++it) {
+      sizes.push_back(size(*it));
+      weights.push_back(weight(*it));
+    }
+  }
+
+  /** @brief totalWeight - sum of weights, bounds every cell of the table.
+   * @return Sum of weights, saturated at maximum of uint64_t.
+   */
+  uint64_t totalWeight() const {
+    uint64_t total = 0;
+    for (uint64_t w : weights)
+      total = w > std::numeric_limits<uint64_t>::max() - total
+                  ? std::numeric_limits<uint64_t>::max()
+                  : total + w;
+    return total;
+  }
+
+  ScratchVector<uint64_t> sizes;
+  ScratchVector<uint64_t> weights;
+};
+
+/** @brief fitsCell - checks if table of given cells holds all weights.
+ * @param total   - total weight of items.
+ * @return True if no cell can overflow.
+ */
+template <class Cell>
+bool fitsCell(uint64_t total) {
+  return total <= std::numeric_limits<Cell>::max();
+}
+
+/** @brief knapsackTable - fills knapsack table of staged items.
+ * @param items[in]   - staged sizes and weights, their total weight must fit
+ *                      in @p Cell;
+ * @param capacity    - capacity of knapsack;
+ * @param arena       - arena for the table, null means the heap.
+ * @return Maximum possible weight of packed items.
+ */
+template <class Cell>
+uint64_t knapsackTable(ItemColumns const& items, uint64_t capacity,
+                       Arena* arena) {
+  size_t n = items.sizes.size();
+  uint64_t stride = capacity + 1;
+  ArenaScope scope(arena);
+  ScratchVector<Cell> vec((n + 1) * stride, 0, ArenaAllocator<Cell>(arena));
+  for (size_t i = 1; i <= n; i++)
+    knapsackRow<Cell>(&vec[(i - 1) * stride], &vec[i * stride], 0, capacity,
+                      items.sizes[i - 1],
+                      static_cast<Cell>(items.weights[i - 1]));
+  return vec[n * stride + capacity];
+}
+
+/** @brief knapsack - solves discrete knapsack problem sequentially.
+ * Columns of table represent maximum possible weight of items not exceeding
+ * capacity. Row i represents first i items, so row 0 is empty knapsack.
+ * Cells are 16, 32 or 64 bits wide, the narrowest holding total weight.
+ * @param first      - beginning of items' range;
+ * @param last       - end of items' range;
+ * @param capacity   - capacity of knapsack;
+ * @param size       - functor providing item's size;
+ * @param weight     - functor providing item's weight;
+ * @param arena      - arena for the table, null means the heap.
+ * @return Maximum possible weight of packed items.
+ */
+template <class RandomIt, class SizeFn, class WeightFn>
+uint64_t knapsack(RandomIt first, RandomIt last, uint64_t capacity,
+                  SizeFn size, WeightFn weight, Arena* arena = nullptr) {
+  if (first == last) return 0;
+  ArenaScope scope(arena);
+  ItemColumns items(arena);
+  items.stage(first, last, size, weight);
+  uint64_t total = items.totalWeight();
+  if (fitsCell<uint16_t>(total))
+    return knapsackTable<uint16_t>(items, capacity, arena);
+  if (fitsCell<uint32_t>(total))
+    return knapsackTable<uint32_t>(items, capacity, arena);
+  return knapsackTable<uint64_t>(items, capacity, arena);
+}
+
+/** @brief RowProgress - number of rows finished by knapsack worker.
+ */
+struct RowProgress {
+  RowProgress() : rows(0) {}
+
+  /** @brief finish - informs that row is finished.
+   * @param row   - index of finished row.
+   */
+  void finish(size_t row) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      rows.store(row + 1, std::memory_order_release);
+    }
+    ready.notify_one();
+  }
+
+  /** @brief await - waits until row is finished.
+   * @param row   - index of awaited row.
+   */
+  void await(size_t row) {
+    if (rows.load(std::memory_order_acquire) > row) return;
+    std::unique_lock<std::mutex> lock(mutex);
+    ready.wait(lock, [this, row]() {
+      return rows.load(std::memory_order_acquire) > row;
+    });
+  }
+
+  std::atomic<size_t> rows;
+  std::mutex mutex;
+  std::condition_variable ready;
+};
+
+/** @brief knapsackColumns - partially solves knapsack problem.
+ * Each worker solves problem for given columns. Worker starts fulfilling
+ * n-th row, when previous worker finished (n-1)-th row and informs when it
+ * finished row.
+ * @param progress[in, out]   - rows finished by each worker;
+ * @param items[in]           - staged sizes and weights of items;
+ * @param vec[in, out]        - table with partial results, row 0 is empty
+ *                              knapsack;
+ * @param stride              - length of table's row;
+ * @param beg                 - index of first column;
+ * @param end                 - index of last column;
+ * @param num                 - number of worker.
+ */
+template <class Cell>
+void knapsackColumns(RowProgress* progress, ItemColumns const* items,
+                     Cell* vec, uint64_t stride, uint64_t beg, uint64_t end,
+                     uint64_t num) {
+  TRACE_SCOPE("knapsack worker", num);
+  size_t n = items->sizes.size();
+  for (size_t i = 1; i <= n; i++) {
+    // Waiting until previous worker finish row.
+    if (num != 0) {
+      TRACE_SCOPE("wait row", i);
+      progress[num - 1].await(i);
+    }
+    TRACE_SCOPE("dp row block", i);
+    knapsackRow<Cell>(vec + (i - 1) * stride, vec + i * stride, beg, end,
+                      items->sizes[i - 1],
+                      static_cast<Cell>(items->weights[i - 1]));
+    // Notifying about finished row.
+    progress[num].finish(i);
+  }
+}
+
+/** @brief parallelKnapsackTable - fills knapsack table of staged items with
+ * workers from the pool.
+ * @param pool[in, out]   - pool executing the work;
+ * @param workers         - number of columns' blocks, at least 2;
+ * @param items[in]       - staged sizes and weights, their total weight must
+ *                          fit in @p Cell;
+ * @param capacity        - capacity of knapsack;
+ * @param shared          - arena for the table, null means the heap.
+ * @return Maximum possible weight of packed items.
+ */
+template <class Cell>
+uint64_t parallelKnapsackTable(ThreadPool& pool, uint64_t workers,
+                               ItemColumns const& items, uint64_t capacity,
+                               Arena* shared) {
+  size_t n = items.sizes.size();
+  ArenaScope scope(shared);
+  uint64_t stride = capacity + 1;
+  ScratchVector<Cell> vec((n + 1) * stride, 0, ArenaAllocator<Cell>(shared));
+  ScratchArray<RowProgress> progress(workers, shared);
+  ScratchVector<std::future<void>> done{
+      ArenaAllocator<std::future<void>>(shared)};
+  done.reserve(workers);
+  uint64_t mod = stride % workers;
+  uint64_t work_size = stride / workers;
+  uint64_t beg = 0;
+  // Distributing the work to workers.
+  for (uint64_t i = 0; i < workers; i++) {
+    uint64_t end = beg + work_size - (i < mod ? 0 : 1);
+    TRACE_INSTANT("spawn knapsack", i);
+    done.push_back(pool.enqueue(knapsackColumns<Cell>, progress.data(),
+                                &items, vec.data(), stride, beg, end, i));
+    beg = end + 1;
+  }
+  // Waiting for result, all workers must leave the table.
+  TRACE_SCOPE("wait knapsack", n);
+  for (auto& future : done) future.get();
+  return vec[n * stride + capacity];
+}
+
+/** @brief parallelKnapsack - solves discrete knapsack problem with workers
+ * from the pool. Each worker fills its block of columns row by row. Single
+ * worker solves the problem on caller's thread. Cells are as narrow as in
+ * @ref knapsack.
+ * @param pool[in, out]   - pool executing the work;
+ * @param workers         - number of columns' blocks;
+ * @param first           - beginning of items' range;
+ * @param last            - end of items' range;
+ * @param capacity        - capacity of knapsack;
+ * @param size            - functor providing item's size;
+ * @param weight          - functor providing item's weight;
+ * @param workspace       - scratch arenas, null means the heap.
+ * @return Maximum possible weight of packed items.
+ */
+template <class RandomIt, class SizeFn, class WeightFn>
+uint64_t parallelKnapsack(ThreadPool& pool, uint64_t workers, RandomIt first,
+                          RandomIt last, uint64_t capacity, SizeFn size,
+                          WeightFn weight, Workspace* workspace = nullptr) {
+  if (first == last) return 0;
+  workers = std::max<uint64_t>(1, std::min(workers, capacity + 1));
+  if (workers == 1)
+    return knapsack(first, last, capacity, size, weight,
+                    localArena(workspace));
+  Arena* shared = sharedArena(workspace);
+  ArenaScope scope(shared);
+  ItemColumns items(shared);
+  items.stage(first, last, size, weight);
+  uint64_t total = items.totalWeight();
+  if (fitsCell<uint16_t>(total))
+    return parallelKnapsackTable<uint16_t>(pool, workers, items, capacity,
+                                           shared);
+  if (fitsCell<uint32_t>(total))
+    return parallelKnapsackTable<uint32_t>(pool, workers, items, capacity,
+                                           shared);
+  return parallelKnapsackTable<uint64_t>(pool, workers, items, capacity,
+                                         shared);
+}
+
+}  // namespace engines
+
+#endif  // SRC_KNAPSACK_H_
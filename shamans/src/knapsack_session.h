@@ -0,0 +1,71 @@
+#ifndef SRC_KNAPSACK_SESSION_H_
+#define SRC_KNAPSACK_SESSION_H_
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+#include "./knapsack.h"
+#include "./trace.h"
+
+namespace engines {
+
+/** @brief KnapsackSession - knapsack problem of growing set of items.
+ * Only the last row of knapsack table is kept. Adding k items costs k rows,
+ * not the whole table, and each cell of the row answers query for its
+ * capacity, so any capacity up to the maximal one is read in constant time.
+ */
+class KnapsackSession {
+ public:
+  /** @brief KnapsackSession - creates session without items.
+   * @param maxCapacityArg   - largest capacity which may be queried.
+   */
+  explicit KnapsackSession(uint64_t maxCapacityArg)
+      : row(maxCapacityArg + 1, 0), spare(maxCapacityArg + 1, 0), count(0) {}
+
+  /** @brief add - adds items to the session.
+   * @param first    - beginning of items' range;
+   * @param last     - end of items' range;
+   * @param size     - functor providing item's size;
+   * @param weight   - functor providing item's weight.
+   */
+  template <class RandomIt, class SizeFn, class WeightFn>
+  void add(RandomIt first, RandomIt last, SizeFn size, WeightFn weight) {
+    TRACE_SCOPE("knapsack session add", last - first);
+    for (RandomIt it = first; it != last; ++it) {
+      knapsackRow<uint64_t>(row.data(), spare.data(), 0, maxCapacity(),
+                            size(*it), weight(*it));
+      row.swap(spare);
+      count++;
+    }
+  }
+
+  /** @brief query - solves knapsack problem of added items.
+   * @param capacity   - capacity of knapsack, at most maximal capacity.
+   * @return Maximum possible weight of packed items.
+   */
+  uint64_t query(uint64_t capacity) const {
+    if (capacity > maxCapacity())
+      throw std::out_of_range("Capacity above session's maximum");
+    return row[capacity];
+  }
+
+  /** @brief clear - removes all items.
+   */
+  void clear() {
+    std::fill(row.begin(), row.end(), 0);
+    count = 0;
+  }
+
+  uint64_t maxCapacity() const { return row.size() - 1; }
+  size_t items() const { return count; }
+
+ private:
+  std::vector<uint64_t> row;
+  std::vector<uint64_t> spare;
+  size_t count;
+};
+
+}  // namespace engines
+
+#endif  // SRC_KNAPSACK_SESSION_H_
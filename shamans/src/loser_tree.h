@@ -0,0 +1,53 @@
+#ifndef SRC_LOSER_TREE_H_
+#define SRC_LOSER_TREE_H_
+
+#include <algorithm>
+#include <vector>
+
+namespace engines {
+
+/** @brief LoserTree - tournament of k sources. Inner node keeps loser of
+ * the match played in it, node 0 keeps the winner. When winner's source
+ * advances only matches on its path are replayed, log2 k comparisons.
+ */
+class LoserTree {
+ public:
+  /** @brief LoserTree - plays all matches.
+   * @param k       - number of sources, at least 1;
+   * @param beats   - beats(a, b) is true if source a wins against b.
+   */
+  template <class Beats>
+  LoserTree(size_t k, Beats beats) : k(k), losers(k) {
+    // Leaves k..2k-1 are sources, inner node p plays winners of 2p, 2p + 1.
+    std::vector<size_t> winners(2 * k);
+    for (size_t i = 0; i < k; i++) winners[k + i] = i;
+    for (size_t node = k - 1; node > 0; node--) {
+      size_t a = winners[2 * node], b = winners[2 * node + 1];
+      bool first = beats(a, b);
+      winners[node] = first ? a : b;
+      losers[node] = first ? b : a;
+    }
+    losers[0] = winners[1];
+  }
+
+  size_t winner() const { return losers[0]; }
+
+  /** @brief replay - updates tournament after winner's source changed.
+   * @param beats   - beats(a, b) is true if source a wins against b.
+   */
+  template <class Beats>
+  void replay(Beats beats) {
+    size_t current = losers[0];
+    for (size_t node = (current + k) / 2; node > 0; node /= 2)
+      if (beats(losers[node], current)) std::swap(losers[node], current);
+    losers[0] = current;
+  }
+
+ private:
+  size_t k;
+  std::vector<size_t> losers;
+};
+
+}  // namespace engines
+
+#endif  // SRC_LOSER_TREE_H_
@@ -0,0 +1,207 @@
+#ifndef SRC_MAX_PLUS_KNAPSACK_H_
+#define SRC_MAX_PLUS_KNAPSACK_H_
+
+#include <algorithm>
+#include <cmath>
+#include <future>
+#include <vector>
+
+#include "../third_party/threadpool/threadpool.h"
+
+#include "./arena.h"
+#include "./knapsack.h"
+#include "./parallel.h"
+#include "./trace.h"
+
+namespace engines {
+
+/** @brief knapsackLastRow - fills last row of knapsack table of some items.
+ * Only two rows are kept, they alternate so the last one lands in @p out.
+ * @param items[in]   - staged sizes and weights of items;
+ * @param begin       - index of first item;
+ * @param end         - index after last item;
+ * @param capacity    - capacity of knapsack;
+ * @param out[out]    - row of @p capacity + 1 cells;
+ * @param arena       - arena for the other row, null means the heap.
+ */
+template <class Cell>
+void knapsackLastRow(ItemColumns const& items, size_t begin, size_t end,
+                     uint64_t capacity, Cell* out, Arena* arena) {
+  TRACE_SCOPE("knapsack group", end - begin);
+  ArenaScope scope(arena);
+  ScratchVector<Cell> other(capacity + 1, 0, ArenaAllocator<Cell>(arena));
+  Cell* prev = (end - begin) % 2 == 0 ? out : other.data();
+  Cell* row = prev == out ? other.data() : out;
+  std::fill(prev, prev + capacity + 1, 0);
+  for (size_t i = begin; i < end; i++) {
+    knapsackRow<Cell>(prev, row, 0, capacity, items.sizes[i],
+                      static_cast<Cell>(items.weights[i]));
+    std::swap(prev, row);
+  }
+}
+
+/** @brief maxPlusColumns - merges two knapsack rows of disjoint items.
+ * Cell j of merged row is maximum of a[k] + b[j - k] over k <= j, so it
+ * costs j + 1 additions.
+ * @param a[in]      - row of first group of items;
+ * @param b[in]      - row of second group of items;
+ * @param out[out]   - merged row;
+ * @param begin      - index of first merged column;
+ * @param end        - index after last merged column.
+ */
+template <class Cell>
+void maxPlusColumns(Cell const* a, Cell const* b, Cell* out, size_t begin,
+                    size_t end) {
+  for (size_t j = begin; j < end; j++) {
+    Cell best = 0;
+    for (size_t k = 0; k <= j; k++) {
+      Cell sum = a[k] + b[j - k];
+      best = best < sum ? sum : best;
+    }
+    out[j] = best;
+  }
+}
+
+/** @brief triangleBounds - splits columns of max-plus merge into chunks of
+ * almost equal work. Column j costs j + 1, so first i chunks end near
+ * n * sqrt(i / chunks).
+ * @param n        - number of columns;
+ * @param chunks   - number of chunks, at least 1.
+ * @return Vector of @p chunks + 1 bounds, like @ref chunkBounds.
+ */
+inline std::vector<size_t> triangleBounds(size_t n, uint64_t chunks) {
+  std::vector<size_t> bounds(chunks + 1, n);
+  for (uint64_t i = 0; i < chunks; i++)
+    bounds[i] = std::min<size_t>(
+        n, static_cast<size_t>(std::ceil(n * std::sqrt(1.0 * i / chunks))));
+  return bounds;
+}
+
+/** @brief maxPlusLevel - merges rows pairwise with workers from the pool.
+ * Columns of each pair are split among workers, odd row is copied.
+ * @param pool[in, out]   - pool executing the work;
+ * @param workers         - number of workers;
+ * @param rows[in]        - @p groups rows;
+ * @param groups          - number of rows, at least 2;
+ * @param merged[out]     - (@p groups + 1) / 2 merged rows;
+ * @param stride          - length of row;
+ * @param shared          - arena for futures, null means the heap.
+ */
+template <class Cell>
+void maxPlusLevel(ThreadPool& pool, uint64_t workers, Cell const* rows,
+                  size_t groups, Cell* merged, uint64_t stride,
+                  Arena* shared) {
+  TRACE_SCOPE("max plus level", groups);
+  ArenaScope scope(shared);
+  size_t pairs = groups / 2;
+  std::vector<size_t> bounds =
+      triangleBounds(stride, std::max<uint64_t>(1, workers / pairs));
+  ScratchVector<std::future<void>> done{
+      ArenaAllocator<std::future<void>>(shared)};
+  done.reserve(pairs * (bounds.size() - 1));
+  for (size_t p = 0; p < pairs; p++) {
+    for (size_t q = 0; q + 1 < bounds.size(); q++) {
+      if (bounds[q] == bounds[q + 1]) continue;
+      done.push_back(pool.enqueue(maxPlusColumns<Cell>,
+                                  rows + 2 * p * stride,
+                                  rows + (2 * p + 1) * stride,
+                                  merged + p * stride, bounds[q],
+                                  bounds[q + 1]));
+    }
+  }
+  if (groups % 2 != 0)
+    std::copy(rows + (groups - 1) * stride, rows + groups * stride,
+              merged + pairs * stride);
+  for (auto& future : done) future.get();
+}
+
+/** @brief itemParallelTable - solves knapsack of staged items split into
+ * groups, one group per worker.
+ * @param pool[in, out]   - pool executing the work;
+ * @param workers         - number of groups, at least 2;
+ * @param items[in]       - staged sizes and weights, their total weight must
+ *                          fit in @p Cell;
+ * @param capacity        - capacity of knapsack;
+ * @param workspace       - scratch arenas, null means the heap.
+ * @return Maximum possible weight of packed items.
+ */
+template <class Cell>
+uint64_t itemParallelTable(ThreadPool& pool, uint64_t workers,
+                           ItemColumns const& items, uint64_t capacity,
+                           Workspace* workspace) {
+  Arena* shared = sharedArena(workspace);
+  ArenaScope scope(shared);
+  uint64_t stride = capacity + 1;
+  size_t groups = workers;
+  ScratchVector<Cell> rows(groups * stride, 0, ArenaAllocator<Cell>(shared));
+  ScratchVector<Cell> merged((groups + 1) / 2 * stride, 0,
+                             ArenaAllocator<Cell>(shared));
+  std::vector<size_t> bounds = chunkBounds(items.sizes.size(), groups);
+  Cell* data = rows.data();
+  parallelChunks(pool, bounds,
+                 [&items, capacity, stride, data, workspace](
+                     size_t chunk, size_t begin, size_t end) {
+                   knapsackLastRow<Cell>(items, begin, end, capacity,
+                                         data + chunk * stride,
+                                         localArena(workspace));
+                 });
+  while (groups > 2) {
+    maxPlusLevel<Cell>(pool, workers, rows.data(), groups, merged.data(),
+                       stride, shared);
+    rows.swap(merged);
+    groups = (groups + 1) / 2;
+  }
+  // Only the last column of the last merge is needed.
+  TRACE_SCOPE("max plus result", capacity);
+  Cell best = 0;
+  for (uint64_t k = 0; k <= capacity; k++) {
+    Cell sum = rows[k] + rows[stride + capacity - k];
+    best = best < sum ? sum : best;
+  }
+  return best;
+}
+
+/** @brief itemParallelKnapsack - solves discrete knapsack problem with
+ * workers from the pool splitting items instead of columns. Each worker
+ * fills last row of its group of items, rows are merged pairwise by max-plus
+ * convolution. Merges cost square of capacity, so it suits many items and
+ * small capacity. Single worker solves the problem on caller's thread. Cells
+ * are as narrow as in @ref knapsack.
+ * @param pool[in, out]   - pool executing the work;
+ * @param workers         - number of groups of items;
+ * @param first           - beginning of items' range;
+ * @param last            - end of items' range;
+ * @param capacity        - capacity of knapsack;
+ * @param size            - functor providing item's size;
+ * @param weight          - functor providing item's weight;
+ * @param workspace       - scratch arenas, null means the heap.
+ * @return Maximum possible weight of packed items.
+ */
+template <class RandomIt, class SizeFn, class WeightFn>
+uint64_t itemParallelKnapsack(ThreadPool& pool, uint64_t workers,
+                              RandomIt first, RandomIt last, uint64_t capacity,
+                              SizeFn size, WeightFn weight,
+                              Workspace* workspace = nullptr) {
+  uint64_t n = last - first;
+  workers = std::max<uint64_t>(1, std::min(workers, n));
+  if (workers == 1)
+    return knapsack(first, last, capacity, size, weight,
+                    localArena(workspace));
+  Arena* shared = sharedArena(workspace);
+  ArenaScope scope(shared);
+  ItemColumns items(shared);
+  items.stage(first, last, size, weight);
+  uint64_t total = items.totalWeight();
+  if (fitsCell<uint16_t>(total))
+    return itemParallelTable<uint16_t>(pool, workers, items, capacity,
+                                       workspace);
+  if (fitsCell<uint32_t>(total))
+    return itemParallelTable<uint32_t>(pool, workers, items, capacity,
+                                       workspace);
+  return itemParallelTable<uint64_t>(pool, workers, items, capacity,
+                                     workspace);
+}
+
+}  // namespace engines
+
+#endif  // SRC_MAX_PLUS_KNAPSACK_H_
@@ -0,0 +1,150 @@
+#ifndef SRC_PACKING_H_
+#define SRC_PACKING_H_
+
+#include <algorithm>
+#include <vector>
+
+#include "./approximate_knapsack.h"
+#include "./arena.h"
+#include "./sparse_knapsack.h"
+#include "./trace.h"
+
+namespace engines {
+
+/** @brief KnapsackItem - item with cached size and weight.
+ */
+struct KnapsackItem {
+  uint64_t size;
+  uint64_t weight;
+
+  bool operator<(KnapsackItem const& other) const {
+    return size < other.size || (size == other.size && weight < other.weight);
+  }
+
+  bool operator==(KnapsackItem const& other) const {
+    return size == other.size && weight == other.weight;
+  }
+};
+
+/** @brief ItemSize - functor providing prepared item's size.
+ */
+struct ItemSize {
+  uint64_t operator()(KnapsackItem const& item) const { return item.size; }
+};
+
+/** @brief ItemWeight - functor providing prepared item's weight.
+ */
+struct ItemWeight {
+  uint64_t operator()(KnapsackItem const& item) const { return item.weight; }
+};
+
+/** @brief prepareItems - shrinks knapsack problem before solving it.
+ * Items which never fit or weigh nothing are dropped, items without size are
+ * always packed. Copies of the same item are limited to as many as fit and
+ * replaced by bundles of 1, 2, 4, ... copies (binary splitting), so any
+ * number of copies is still a subset of bundles. Items are sorted by size.
+ * When all items fit, none is left to solve.
+ * @param first        - beginning of items' range;
+ * @param last         - end of items' range;
+ * @param capacity     - capacity of knapsack;
+ * @param size         - functor providing item's size;
+ * @param weight       - functor providing item's weight;
+ * @param items[out]   - items left to solve.
+ * @return Weight of items packed without solving.
+ */
+template <class RandomIt, class SizeFn, class WeightFn>
+uint64_t prepareItems(RandomIt first, RandomIt last, uint64_t capacity,
+                      SizeFn size, WeightFn weight,
+                      ScratchVector<KnapsackItem>& items) {
+  TRACE_SCOPE("prepare items", last - first);
+  items.clear();
+  uint64_t packed = 0, left = capacity, totalWeight = 0;
+  bool allFit = true;
+  for (RandomIt it = first; it != last; ++it) {
+    uint64_t s = size(*it);
+    if (s > capacity) continue;
+    uint64_t w = weight(*it);
+    if (w == 0) continue;
+    if (s == 0) {
+      packed += w;
+      continue;
+    }
+    items.push_back({s, w});
+    // Space left by previous items is tracked, their sum could overflow.
+    allFit = allFit && s <= left;
+    if (allFit) left -= s;
+    totalWeight += w;
+  }
+  if (allFit) {
+    items.clear();
+    return packed + totalWeight;
+  }
+  std::sort(items.begin(), items.end());
+  // Bundles replace copies in place, they never outnumber copies.
+  size_t out = 0;
+  for (size_t i = 0; i < items.size();) {
+    KnapsackItem item = items[i];
+    size_t j = i;
+    while (j < items.size() && items[j] == item) j++;
+    uint64_t copies = std::min<uint64_t>(j - i, capacity / item.size);
+    for (uint64_t bundle = 1; copies > 0; bundle *= 2) {
+      uint64_t taken = std::min(bundle, copies);
+      items[out++] = {taken * item.size, taken * item.weight};
+      copies -= taken;
+    }
+    i = j;
+  }
+  items.resize(out);
+  // Bundles may break size order.
+  std::sort(items.begin(), items.end());
+  return packed;
+}
+
+/** @brief packKnapsack - prepares items and solves knapsack problem with
+ * algorithm picked by @ref chooseKnapsackEngine.
+ * @param first      - beginning of items' range;
+ * @param last       - end of items' range;
+ * @param capacity   - capacity of knapsack;
+ * @param size       - functor providing item's size;
+ * @param weight     - functor providing item's weight;
+ * @param arena      - arena for scratch memory, null means the heap.
+ * @return Maximum possible weight of packed items.
+ */
+template <class RandomIt, class SizeFn, class WeightFn>
+uint64_t packKnapsack(RandomIt first, RandomIt last, uint64_t capacity,
+                      SizeFn size, WeightFn weight, Arena* arena = nullptr) {
+  ArenaScope scope(arena);
+  ScratchVector<KnapsackItem> items{ArenaAllocator<KnapsackItem>(arena)};
+  uint64_t packed = prepareItems(first, last, capacity, size, weight, items);
+  return packed + autoKnapsack(items.begin(), items.end(), capacity,
+                               ItemSize(), ItemWeight(), arena);
+}
+
+/** @brief packApproximately - prepares items and solves knapsack problem
+ * within relative error, see @ref approximateKnapsack.
+ * @param first      - beginning of items' range;
+ * @param last       - end of items' range;
+ * @param capacity   - capacity of knapsack;
+ * @param size       - functor providing item's size;
+ * @param weight     - functor providing item's weight;
+ * @param epsilon    - allowed relative error;
+ * @param arena      - arena for scratch memory, null means the heap.
+ * @return Weight of packed items and upper bound of optimum.
+ */
+template <class RandomIt, class SizeFn, class WeightFn>
+ApproximateWeight packApproximately(RandomIt first, RandomIt last,
+                                    uint64_t capacity, SizeFn size,
+                                    WeightFn weight, double epsilon,
+                                    Arena* arena = nullptr) {
+  ArenaScope scope(arena);
+  ScratchVector<KnapsackItem> items{ArenaAllocator<KnapsackItem>(arena)};
+  uint64_t packed = prepareItems(first, last, capacity, size, weight, items);
+  ApproximateWeight result =
+      approximateKnapsack(items.begin(), items.end(), capacity, ItemSize(),
+                          ItemWeight(), epsilon, arena);
+  return {packed + result.weight, packed + result.bound};
+}
+
+}  // namespace engines
+
+#endif  // SRC_PACKING_H_
@@ -0,0 +1,49 @@
+#ifndef SRC_PARALLEL_H_
+#define SRC_PARALLEL_H_
+
+#include <algorithm>
+#include <future>
+#include <vector>
+
+#include "../third_party/threadpool/threadpool.h"
+
+namespace engines {
+
+/** @brief chunkBounds - splits elements into chunks of almost equal size.
+ * First @p n % @p chunks chunks are one element larger than others.
+ * @param n        - number of elements;
+ * @param chunks   - number of chunks, at least 1.
+ * @return Vector of @p chunks + 1 bounds, chunk i is [bounds[i],
+ * bounds[i + 1]).
+ */
+inline std::vector<size_t> chunkBounds(size_t n, uint64_t chunks) {
+  std::vector<size_t> bounds(chunks + 1, 0);
+  uint64_t mod = n % chunks;
+  uint64_t work_size = n / chunks;
+  for (uint64_t i = 0; i < chunks; i++)
+    bounds[i + 1] = bounds[i] + work_size + (i < mod ? 1 : 0);
+  return bounds;
+}
+
+/** @brief parallelChunks - executes function for each chunk on the pool and
+ * waits until all chunks are processed. Single chunk is processed on caller's
+ * thread.
+ * @param pool[in, out]   - pool executing the work;
+ * @param bounds[in]      - chunks' bounds created by @ref chunkBounds;
+ * @param f               - function called as f(chunk, begin, end).
+ */
+template <class F>
+void parallelChunks(ThreadPool& pool, std::vector<size_t> const& bounds,
+                    F f) {
+  if (bounds.size() == 2) return f(0, bounds[0], bounds[1]);
+  std::vector<std::future<void>> futures;
+  for (size_t i = 0; i + 1 < bounds.size(); i++) {
+    size_t begin = bounds[i], end = bounds[i + 1];
+    futures.push_back(pool.enqueue([&f, i, begin, end]() { f(i, begin, end); }));
+  }
+  for (auto& future : futures) future.get();
+}
+
+}  // namespace engines
+
+#endif  // SRC_PARALLEL_H_
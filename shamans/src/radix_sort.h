@@ -0,0 +1,248 @@
+#ifndef SRC_RADIX_SORT_H_
+#define SRC_RADIX_SORT_H_
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <type_traits>
+#include <vector>
+
+#include "../third_party/threadpool/threadpool.h"
+
+#include "./parallel.h"
+#include "./sort.h"
+#include "./sorting_network.h"
+#include "./trace.h"
+
+namespace engines {
+
+const unsigned kRadixBits = 8;
+const size_t kRadixBuckets = 1 << kRadixBits;
+const unsigned kRadixPasses = 64 / kRadixBits;
+
+/** @brief digit - provides radix digit of key.
+ * @param key    - element's key;
+ * @param pass   - number of digit, 0 is the least significant one.
+ * @return Value of digit.
+ */
+inline size_t digit(uint64_t key, unsigned pass) {
+  return (key >> (pass * kRadixBits)) & (kRadixBuckets - 1);
+}
+
+/** @brief RadixCounts - histograms of all digits' values.
+ */
+struct RadixCounts {
+  RadixCounts() : counts(kRadixPasses, std::vector<size_t>(kRadixBuckets)) {}
+
+  std::vector<std::vector<size_t>> counts;
+};
+
+/** @brief countDigits - counts values of all digits of range's keys.
+ * @param first         - beginning of range;
+ * @param last          - end of range;
+ * @param result[out]   - histograms to increase.
+ */
+template <class It>
+void countDigits(It first, It last, RadixCounts& result) {
+  typedef SortKey<typename std::iterator_traits<It>::value_type> Key;
+  for (It it = first; it != last; ++it) {
+    uint64_t key = Key::get(*it);
+    for (unsigned pass = 0; pass < kRadixPasses; pass++)
+      result.counts[pass][digit(key, pass)]++;
+  }
+}
+
+/** @brief scatter - stably moves elements to their digit's buckets.
+ * @param first             - beginning of source range;
+ * @param last              - end of source range;
+ * @param out               - beginning of destination range;
+ * @param pass              - number of digit;
+ * @param offsets[in, out]  - first free position of each bucket.
+ */
+template <class InIt, class OutIt>
+void scatter(InIt first, InIt last, OutIt out, unsigned pass,
+             std::vector<size_t>& offsets) {
+  typedef SortKey<typename std::iterator_traits<InIt>::value_type> Key;
+  for (InIt it = first; it != last; ++it)
+    out[offsets[digit(Key::get(*it), pass)]++] = *it;
+}
+
+/** @brief trivialPass - checks if all keys have the same digit.
+ * Such pass doesn't change order, so it's skipped.
+ * @param total[in]   - histogram of digit;
+ * @param n           - number of elements.
+ * @return True if pass can be skipped.
+ */
+inline bool trivialPass(std::vector<size_t> const& total, size_t n) {
+  return std::find(total.begin(), total.end(), n) != total.end();
+}
+
+/** @brief radixSort - sorts range by elements' keys with LSD radix sort.
+ * Element type must have @ref SortKey specialization.
+ * @param first   - beginning of range;
+ * @param last    - end of range.
+ */
+template <class RandomIt>
+void radixSort(RandomIt first, RandomIt last) {
+  typedef typename std::iterator_traits<RandomIt>::value_type T;
+  static_assert(SortKey<T>::available, "Element type has no sort key");
+  size_t n = last - first;
+  if (n < 2) return;
+  RadixCounts histograms;
+  countDigits(first, last, histograms);
+  std::vector<T> buffer(first, last);
+  bool inBuffer = false;
+  for (unsigned pass = 0; pass < kRadixPasses; pass++) {
+    std::vector<size_t>& count = histograms.counts[pass];
+    if (trivialPass(count, n)) continue;
+    std::vector<size_t> offsets(kRadixBuckets, 0);
+    for (size_t d = 1; d < kRadixBuckets; d++)
+      offsets[d] = offsets[d - 1] + count[d - 1];
+    if (inBuffer)
+      scatter(buffer.begin(), buffer.end(), first, pass, offsets);
+    else
+      scatter(first, last, buffer.begin(), pass, offsets);
+    inBuffer = !inBuffer;
+  }
+  if (inBuffer) std::copy(buffer.begin(), buffer.end(), first);
+}
+
+/** @brief parallelRadixSort - sorts range by elements' keys with LSD radix
+ * sort, with workers from the pool. In each pass workers count digits of
+ * their chunks in parallel, then scatter their chunks to disjoint positions.
+ * Element type must have @ref SortKey specialization.
+ * @param pool[in, out]   - pool executing the work;
+ * @param workers         - number of chunks;
+ * @param first           - beginning of range;
+ * @param last            - end of range.
+ */
+template <class RandomIt>
+void parallelRadixSort(ThreadPool& pool, uint64_t workers, RandomIt first,
+                       RandomIt last) {
+  typedef typename std::iterator_traits<RandomIt>::value_type T;
+  typedef typename std::vector<T>::iterator BufferIt;
+  static_assert(SortKey<T>::available, "Element type has no sort key");
+  size_t n = last - first;
+  if (n < 2) return;
+  workers = std::max<uint64_t>(1, std::min<uint64_t>(workers, n));
+  if (workers == 1) return radixSort(first, last);
+  std::vector<size_t> bounds = chunkBounds(n, workers);
+  std::vector<RadixCounts> histograms(workers);
+  parallelChunks(pool, bounds, [&](size_t chunk, size_t begin, size_t end) {
+    TRACE_SCOPE("radix histogram", end - begin);
+    countDigits(first + begin, first + end, histograms[chunk]);
+  });
+  std::vector<T> buffer(first, last);
+  bool inBuffer = false;
+  bool countsValid = true;
+  for (unsigned pass = 0; pass < kRadixPasses; pass++) {
+    std::vector<size_t> total(kRadixBuckets, 0);
+    for (uint64_t w = 0; w < workers; w++)
+      for (size_t d = 0; d < kRadixBuckets; d++)
+        total[d] += histograms[w].counts[pass][d];
+    if (trivialPass(total, n)) continue;
+    // Chunks' histograms describe original order only, later passes
+    // need histograms of current order.
+    if (!countsValid) {
+      parallelChunks(pool, bounds, [&](size_t chunk, size_t begin,
+                                       size_t end) {
+        TRACE_SCOPE("radix histogram", end - begin);
+        std::vector<size_t>& count = histograms[chunk].counts[pass];
+        std::fill(count.begin(), count.end(), 0);
+        for (size_t i = begin; i < end; i++) {
+          uint64_t key = inBuffer ? SortKey<T>::get(buffer[i])
+                                  : SortKey<T>::get(first[i]);
+          count[digit(key, pass)]++;
+        }
+      });
+    }
+    countsValid = false;
+    // Offset of chunk's bucket follows smaller digits and the same digit
+    // of previous chunks, which keeps sort stable.
+    std::vector<std::vector<size_t>> offsets(
+        workers, std::vector<size_t>(kRadixBuckets));
+    size_t position = 0;
+    for (size_t d = 0; d < kRadixBuckets; d++) {
+      for (uint64_t w = 0; w < workers; w++) {
+        offsets[w][d] = position;
+        position += histograms[w].counts[pass][d];
+      }
+    }
+    parallelChunks(pool, bounds, [&](size_t chunk, size_t begin, size_t end) {
+      TRACE_SCOPE("radix scatter", end - begin);
+      if (inBuffer) {
+        BufferIt source = buffer.begin();
+        scatter(source + begin, source + end, first, pass, offsets[chunk]);
+      } else {
+        scatter(first + begin, first + end, buffer.begin(), pass,
+                offsets[chunk]);
+      }
+    });
+    inBuffer = !inBuffer;
+  }
+  if (inBuffer) {
+    parallelChunks(pool, bounds, [&](size_t, size_t begin, size_t end) {
+      std::copy(buffer.begin() + begin, buffer.begin() + end, first + begin);
+    });
+  }
+}
+
+namespace detail {
+template <class RandomIt, class Compare>
+void sortByKey(RandomIt first, RandomIt last, Compare, std::true_type) {
+  radixSort(first, last);
+}
+
+template <class RandomIt, class Compare>
+void sortByKey(RandomIt first, RandomIt last, Compare comp, std::false_type) {
+  mergeSort(first, last, comp);
+}
+
+template <class RandomIt, class Compare>
+void parallelSortByKey(ThreadPool& pool, uint64_t workers, RandomIt first,
+                       RandomIt last, Compare, std::true_type) {
+  parallelRadixSort(pool, workers, first, last);
+}
+
+template <class RandomIt, class Compare>
+void parallelSortByKey(ThreadPool& pool, uint64_t workers, RandomIt first,
+                       RandomIt last, Compare comp, std::false_type) {
+  parallelMergeSort(pool, workers, first, last, comp);
+}
+}  // namespace detail
+
+/** @brief sortByKey - sorts range with radix sort if elements have integer
+ * key consistent with comparator, otherwise with merge sort.
+ * @param first   - beginning of range;
+ * @param last    - end of range;
+ * @param comp    - strict weak ordering of elements.
+ */
+template <class RandomIt, class Compare>
+void sortByKey(RandomIt first, RandomIt last, Compare comp) {
+  detail::sortByKey(
+      first, last, comp,
+      std::integral_constant<bool,
+                             detail::HasSortKey<RandomIt, Compare>::value>());
+}
+
+/** @brief parallelSortByKey - sorts range with parallel radix sort if
+ * elements have integer key consistent with comparator, otherwise with
+ * parallel merge sort.
+ * @param pool[in, out]   - pool executing the work;
+ * @param workers         - number of workers;
+ * @param first           - beginning of range;
+ * @param last            - end of range;
+ * @param comp            - strict weak ordering of elements.
+ */
+template <class RandomIt, class Compare>
+void parallelSortByKey(ThreadPool& pool, uint64_t workers, RandomIt first,
+                       RandomIt last, Compare comp) {
+  detail::parallelSortByKey(
+      pool, workers, first, last, comp,
+      std::integral_constant<bool,
+                             detail::HasSortKey<RandomIt, Compare>::value>());
+}
+
+}  // namespace engines
+
+#endif  // SRC_RADIX_SORT_H_
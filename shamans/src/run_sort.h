@@ -0,0 +1,303 @@
+#ifndef SRC_RUN_SORT_H_
+#define SRC_RUN_SORT_H_
+
+#include <algorithm>
+#include <iterator>
+#include <vector>
+
+#include "../third_party/threadpool/threadpool.h"
+
+#include "./arena.h"
+#include "./parallel.h"
+#include "./trace.h"
+
+namespace engines {
+
+// Shorter natural runs are extended by binary insertion.
+const size_t kMinRun = 32;
+// Consecutive wins of one side after which merge gallops.
+const size_t kMinGallop = 7;
+
+/** @brief gallop - finds partition point searching from the beginning.
+ * Probes 1, 2, 4, ... elements, then searches binary, so position k costs
+ * O(log k) predicate calls.
+ * @param first   - beginning of range;
+ * @param last    - end of range;
+ * @param pred    - predicate true for prefix of range only.
+ * @return First element for which @p pred is false.
+ */
+template <class RandomIt, class Predicate>
+RandomIt gallop(RandomIt first, RandomIt last, Predicate pred) {
+  size_t n = last - first;
+  size_t lo = 0, hi = n, step = 1;
+  while (lo < n) {
+    size_t probe = std::min(n - 1, lo + step - 1);
+    if (!pred(first[probe])) {
+      hi = probe;
+      break;
+    }
+    lo = probe + 1;
+    step *= 2;
+  }
+  return std::partition_point(first + lo, first + hi, pred);
+}
+
+/** @brief gallopBack - finds partition point searching from the end.
+ * @param first   - beginning of range;
+ * @param last    - end of range;
+ * @param pred    - predicate true for prefix of range only.
+ * @return First element for which @p pred is false.
+ */
+template <class RandomIt, class Predicate>
+RandomIt gallopBack(RandomIt first, RandomIt last, Predicate pred) {
+  size_t lo = 0, hi = last - first, step = 1;
+  while (hi > 0) {
+    size_t probe = hi > step ? hi - step : 0;
+    if (pred(first[probe])) {
+      lo = probe + 1;
+      break;
+    }
+    hi = probe;
+    step *= 2;
+  }
+  return std::partition_point(first + lo, first + hi, pred);
+}
+
+/** @brief gallopMerge - merges two sorted adjacent ranges, stable.
+ * Ordered boundary costs single comparison. Elements already in place at
+ * both ends are skipped by galloping, the rest of the left range is copied
+ * and merged, galloping through long streaks of one side.
+ * @param first    - beginning of first range;
+ * @param middle   - end of first range and beginning of second one;
+ * @param last     - end of second range;
+ * @param comp     - strict weak ordering of elements;
+ * @param arena    - arena for copy of left range, null means the heap.
+ */
+template <class RandomIt, class Compare>
+void gallopMerge(RandomIt first, RandomIt middle, RandomIt last, Compare comp,
+                 Arena* arena = nullptr) {
+  typedef typename std::iterator_traits<RandomIt>::value_type T;
+  if (first == middle || middle == last) return;
+  if (!comp(*middle, *(middle - 1))) return;
+  // Left elements not greater than the first right one stay in place, so do
+  // right elements not less than the last left one.
+  first = gallop(first, middle,
+                 [&comp, middle](T const& x) { return !comp(*middle, x); });
+  last = gallopBack(middle, last, [&comp, middle](T const& x) {
+    return comp(x, *(middle - 1));
+  });
+  ArenaScope scope(arena);
+  ScratchVector<T> left(first, middle, ArenaAllocator<T>(arena));
+  typename ScratchVector<T>::iterator l = left.begin();
+  RandomIt r = middle, out = first;
+  size_t leftWins = 0, rightWins = 0;
+  while (l != left.end() && r != last) {
+    if (comp(*r, *l)) {
+      *out = *r;
+      ++out;
+      ++r;
+      leftWins = 0;
+      if (++rightWins >= kMinGallop && r != last) {
+        T const& key = *l;
+        RandomIt stop =
+            gallop(r, last, [&comp, &key](T const& x) { return comp(x, key); });
+        out = std::copy(r, stop, out);
+        r = stop;
+        rightWins = 0;
+      }
+    } else {
+      *out = *l;
+      ++out;
+      ++l;
+      rightWins = 0;
+      if (++leftWins >= kMinGallop && l != left.end()) {
+        T const& key = *r;
+        typename ScratchVector<T>::iterator stop = gallop(
+            l, left.end(), [&comp, &key](T const& x) { return !comp(key, x); });
+        out = std::copy(l, stop, out);
+        l = stop;
+        leftWins = 0;
+      }
+    }
+  }
+  // Rest of the right range is already in place.
+  std::copy(l, left.end(), out);
+}
+
+/** @brief naturalRun - sorts run starting at given element.
+ * Nondecreasing run is kept, strictly decreasing one is reversed (so equal
+ * elements keep their order) and runs shorter than @ref kMinRun are extended
+ * by binary insertion.
+ * @param first   - beginning of range;
+ * @param begin   - index of run's first element;
+ * @param n       - number of elements of range;
+ * @param comp    - strict weak ordering of elements.
+ * @return Index after run's last element.
+ */
+template <class RandomIt, class Compare>
+size_t naturalRun(RandomIt first, size_t begin, size_t n, Compare comp) {
+  size_t i = begin + 1;
+  if (i >= n) return n;
+  if (comp(first[i], first[i - 1])) {
+    do {
+      i++;
+    } while (i < n && comp(first[i], first[i - 1]));
+    std::reverse(first + begin, first + i);
+  } else {
+    do {
+      i++;
+    } while (i < n && !comp(first[i], first[i - 1]));
+  }
+  for (size_t end = std::min(n, begin + kMinRun); i < end; i++) {
+    RandomIt position =
+        std::upper_bound(first + begin, first + i, first[i], comp);
+    std::rotate(position, first + i, first + i + 1);
+  }
+  return i;
+}
+
+/** @brief runPower - depth of boundary between adjacent runs in powersort's
+ * tree, runs meeting at deeper node are merged earlier.
+ * @param begin    - index of first run;
+ * @param first    - length of first run;
+ * @param second   - length of second run;
+ * @param n        - number of sorted elements.
+ * @return Power of boundary.
+ */
+inline int runPower(size_t begin, size_t first, size_t second, size_t n) {
+  // Doubled midpoints of runs, compared bit by bit as fractions of n.
+  size_t a = 2 * begin + first;
+  size_t b = a + first + second;
+  int power = 0;
+  while (true) {
+    power++;
+    if (a >= n) {
+      a -= n;
+      b -= n;
+    } else if (b >= n) {
+      break;
+    }
+    a <<= 1;
+    b <<= 1;
+  }
+  return power;
+}
+
+/** @brief runSort - sorts given range sequentially, adapting to existing
+ * order (powersort). Natural runs are merged in order given by their
+ * boundaries' powers, which keeps merges balanced. Sorted range costs n - 1
+ * comparisons, range made of k runs O(n log k).
+ * @param first   - beginning of range;
+ * @param last    - end of range;
+ * @param comp    - strict weak ordering of elements;
+ * @param arena   - arena for temporary copies, null means the heap.
+ */
+template <class RandomIt, class Compare>
+void runSort(RandomIt first, RandomIt last, Compare comp,
+             Arena* arena = nullptr) {
+  struct Run {
+    size_t begin;
+    int power;
+  };
+  size_t n = last - first;
+  if (n < 2) return;
+  TRACE_SCOPE("run sort", n);
+  ArenaScope scope(arena);
+  ScratchVector<Run> stack{ArenaAllocator<Run>(arena)};
+  size_t begin = 0, end = naturalRun(first, 0, n, comp);
+  while (end < n) {
+    size_t next = naturalRun(first, end, n, comp);
+    int power = runPower(begin, end - begin, next - end, n);
+    // Runs on the stack end where the current one begins.
+    while (!stack.empty() && stack.back().power > power) {
+      gallopMerge(first + stack.back().begin, first + begin, first + end, comp,
+                  arena);
+      begin = stack.back().begin;
+      stack.pop_back();
+    }
+    stack.push_back({begin, power});
+    begin = end;
+    end = next;
+  }
+  while (!stack.empty()) {
+    gallopMerge(first + stack.back().begin, first + begin, last, comp, arena);
+    begin = stack.back().begin;
+    stack.pop_back();
+  }
+}
+
+/** @brief runBoundary - finds first run boundary in given range.
+ * @param first   - beginning of sorted range;
+ * @param begin   - index of first checked element, positive;
+ * @param end     - index after last checked element;
+ * @param comp    - strict weak ordering of elements.
+ * @return Index of first element less than its predecessor, or @p end.
+ */
+template <class RandomIt, class Compare>
+size_t runBoundary(RandomIt first, size_t begin, size_t end, Compare comp) {
+  while (begin < end && !comp(first[begin], first[begin - 1])) begin++;
+  return begin;
+}
+
+/** @brief parallelRunSort - sorts given range with workers from the pool,
+ * adapting to existing order. Range is split at first run boundaries
+ * within equal chunks, so long runs are not cut. Workers sort their chunks with
+ * @ref runSort, then neighbouring chunks are merged pairwise, level by level.
+ * Single worker sorts on caller's thread.
+ * @param pool[in, out]   - pool executing the work;
+ * @param workers         - maximal number of chunks;
+ * @param first           - beginning of range;
+ * @param last            - end of range;
+ * @param comp            - strict weak ordering of elements;
+ * @param workspace       - scratch arenas, null means the heap.
+ */
+template <class RandomIt, class Compare>
+void parallelRunSort(ThreadPool& pool, uint64_t workers, RandomIt first,
+                     RandomIt last, Compare comp,
+                     Workspace* workspace = nullptr) {
+  size_t n = last - first;
+  if (n < 2) return;
+  if (workers <= 1) return runSort(first, last, comp, localArena(workspace));
+  std::vector<size_t> bounds = chunkBounds(n, workers);
+  {
+    TRACE_SCOPE("find run boundaries", workers);
+    // Each chunk scans only itself, chunk without boundary joins the next.
+    std::vector<size_t> snapped(bounds);
+    parallelChunks(pool, bounds,
+                   [first, comp, &snapped](size_t chunk, size_t begin,
+                                           size_t end) {
+                     if (chunk != 0)
+                       snapped[chunk] = runBoundary(first, begin, end, comp);
+                   });
+    for (size_t i = snapped.size() - 1; i-- > 1;)
+      if (snapped[i] == bounds[i + 1]) snapped[i] = snapped[i + 1];
+    bounds.swap(snapped);
+  }
+  bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+  parallelChunks(pool, bounds,
+                 [first, comp, workspace](size_t, size_t begin, size_t end) {
+                   runSort(first + begin, first + end, comp,
+                           localArena(workspace));
+                 });
+  while (bounds.size() > 2) {
+    TRACE_SCOPE("merge chunks", bounds.size() - 1);
+    size_t chunks = bounds.size() - 1;
+    std::vector<size_t> pairs = chunkBounds(chunks / 2, chunks / 2);
+    parallelChunks(pool, pairs,
+                   [first, comp, workspace, &bounds](size_t pair, size_t,
+                                                     size_t) {
+                     gallopMerge(first + bounds[2 * pair],
+                                 first + bounds[2 * pair + 1],
+                                 first + bounds[2 * pair + 2], comp,
+                                 localArena(workspace));
+                   });
+    std::vector<size_t> merged;
+    for (size_t i = 0; i < bounds.size(); i += 2) merged.push_back(bounds[i]);
+    if (chunks % 2 != 0) merged.push_back(bounds.back());
+    bounds.swap(merged);
+  }
+}
+
+}  // namespace engines
+
+#endif  // SRC_RUN_SORT_H_
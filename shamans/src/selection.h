@@ -0,0 +1,171 @@
+#ifndef SRC_SELECTION_H_
+#define SRC_SELECTION_H_
+
+#include <algorithm>
+#include <future>
+#include <vector>
+
+#include "../third_party/threadpool/threadpool.h"
+
+#include "./arena.h"
+#include "./loser_tree.h"
+#include "./parallel.h"
+#include "./trace.h"
+
+namespace engines {
+
+/** @brief maxElement - finds first largest element of given range.
+ * @param first   - beginning of range;
+ * @param last    - end of range;
+ * @param comp    - strict weak ordering of elements.
+ * @return Iterator to largest element or @p last if range is empty.
+ */
+template <class RandomIt, class Compare>
+RandomIt maxElement(RandomIt first, RandomIt last, Compare comp) {
+  if (first == last) return last;
+  RandomIt best = first;
+  for (RandomIt it = first + 1; it != last; ++it)
+    if (comp(*best, *it)) best = it;
+  return best;
+}
+
+/** @brief parallelMaxElement - finds largest element with workers from pool.
+ * Range is split into @p workers chunks of almost equal size, each worker
+ * finds best element of its chunk. Single worker scans on caller's thread.
+ * @param pool[in, out]   - pool executing the work;
+ * @param workers         - number of chunks;
+ * @param first           - beginning of range;
+ * @param last            - end of range;
+ * @param comp            - strict weak ordering of elements;
+ * @param workspace       - scratch arenas, null means the heap.
+ * @return Iterator to largest element or @p last if range is empty.
+ */
+template <class RandomIt, class Compare>
+RandomIt parallelMaxElement(ThreadPool& pool, uint64_t workers,
+                            RandomIt first, RandomIt last, Compare comp,
+                            Workspace* workspace = nullptr) {
+  uint64_t n = last - first;
+  if (n == 0) return last;
+  workers = std::max<uint64_t>(1, std::min(workers, n));
+  if (workers == 1) return maxElement(first, last, comp);
+  uint64_t mod = n % workers;
+  uint64_t work_size = n / workers;
+  Arena* shared = sharedArena(workspace);
+  ArenaScope scope(shared);
+  ScratchVector<std::future<RandomIt>> futures{
+      ArenaAllocator<std::future<RandomIt>>(shared)};
+  futures.reserve(workers);
+  RandomIt begin = first;
+  // Distributing the work.
+  for (uint64_t i = 0; i < workers; i++) {
+    RandomIt end = begin + work_size + (i < mod ? 1 : 0);
+    TRACE_INSTANT("spawn chunk", i);
+    futures.push_back(pool.enqueue([begin, end, comp]() {
+      TRACE_SCOPE("max chunk", end - begin);
+      return maxElement(begin, end, comp);
+    }));
+    begin = end;
+  }
+  TRACE_SCOPE("wait chunks", workers);
+  RandomIt best = futures[0].get();
+  for (uint64_t i = 1; i < workers; i++) {
+    RandomIt candidate = futures[i].get();
+    if (comp(*best, *candidate)) best = candidate;
+  }
+  return best;
+}
+
+/** @brief Better - orders iterators from the best element, larger element
+ * first and earlier one first among equal elements.
+ */
+template <class RandomIt, class Compare>
+struct Better {
+  Compare comp;
+
+  bool operator()(RandomIt a, RandomIt b) const {
+    return comp(*b, *a) || (a < b && !comp(*a, *b));
+  }
+};
+
+/** @brief topElements - finds @p k largest elements of given range.
+ * Kept elements form a heap with the worst of them on top, element enters
+ * only if it's better than the top, so it costs O(n log k) comparisons.
+ * @param first   - beginning of range;
+ * @param last    - end of range;
+ * @param k       - number of elements;
+ * @param comp    - strict weak ordering of elements.
+ * @return Iterators to min(k, n) largest elements, from the largest one,
+ * earlier elements first among equal ones.
+ */
+template <class RandomIt, class Compare>
+std::vector<RandomIt> topElements(RandomIt first, RandomIt last, size_t k,
+                                  Compare comp) {
+  Better<RandomIt, Compare> better{comp};
+  std::vector<RandomIt> heap;
+  heap.reserve(std::min<size_t>(k, last - first));
+  if (k == 0) return heap;
+  for (RandomIt it = first; it != last; ++it) {
+    if (heap.size() < k) {
+      heap.push_back(it);
+      std::push_heap(heap.begin(), heap.end(), better);
+    } else if (better(it, heap.front())) {
+      std::pop_heap(heap.begin(), heap.end(), better);
+      heap.back() = it;
+      std::push_heap(heap.begin(), heap.end(), better);
+    }
+  }
+  std::sort_heap(heap.begin(), heap.end(), better);
+  return heap;
+}
+
+/** @brief parallelTopElements - finds @p k largest elements with workers
+ * from the pool. Each worker keeps heap of its chunk's best elements, then
+ * chunks' lists are merged by tournament until @p k elements are taken.
+ * Single worker scans on caller's thread.
+ * @param pool[in, out]   - pool executing the work;
+ * @param workers         - number of chunks;
+ * @param first           - beginning of range;
+ * @param last            - end of range;
+ * @param k               - number of elements;
+ * @param comp            - strict weak ordering of elements.
+ * @return Iterators to min(k, n) largest elements, see @ref topElements.
+ */
+template <class RandomIt, class Compare>
+std::vector<RandomIt> parallelTopElements(ThreadPool& pool, uint64_t workers,
+                                          RandomIt first, RandomIt last,
+                                          size_t k, Compare comp) {
+  uint64_t n = last - first;
+  workers = std::max<uint64_t>(1, std::min(workers, n));
+  if (workers == 1) return topElements(first, last, k, comp);
+  std::vector<std::vector<RandomIt>> chunks(workers);
+  parallelChunks(pool, chunkBounds(n, workers),
+                 [first, k, comp, &chunks](size_t chunk, size_t begin,
+                                           size_t end) {
+                   TRACE_SCOPE("top chunk", end - begin);
+                   chunks[chunk] =
+                       topElements(first + begin, first + end, k, comp);
+                 });
+  TRACE_SCOPE("merge top chunks", workers);
+  Better<RandomIt, Compare> better{comp};
+  std::vector<size_t> taken(workers, 0);
+  // Exhausted chunks lose every match.
+  auto beats = [&chunks, &taken, &better](size_t a, size_t b) {
+    if (taken[a] == chunks[a].size()) return false;
+    if (taken[b] == chunks[b].size()) return true;
+    return better(chunks[a][taken[a]], chunks[b][taken[b]]);
+  };
+  LoserTree tree(workers, beats);
+  std::vector<RandomIt> result;
+  result.reserve(std::min<uint64_t>(k, n));
+  while (result.size() < k) {
+    size_t winner = tree.winner();
+    if (taken[winner] == chunks[winner].size()) break;
+    result.push_back(chunks[winner][taken[winner]++]);
+    tree.replay(beats);
+  }
+  return result;
+}
+
+}  // namespace engines
+
+#endif  // SRC_SELECTION_H_
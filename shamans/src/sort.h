@@ -0,0 +1,168 @@
+#ifndef SRC_SORT_H_
+#define SRC_SORT_H_
+
+#include <algorithm>
+#include <future>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "../third_party/threadpool/threadpool.h"
+
+#include "./arena.h"
+#include "./sorting_network.h"
+#include "./trace.h"
+
+namespace engines {
+
+/** @brief merge - merges two sorted adjacent ranges to increasing sequence.
+ * @param first    - beginning of first range;
+ * @param middle   - end of first range and beginning of second one;
+ * @param last     - end of second range;
+ * @param comp     - strict weak ordering of elements;
+ * @param arena    - arena for temporary copies, null means the heap.
+ */
+template <class RandomIt, class Compare>
+void merge(RandomIt first, RandomIt middle, RandomIt last, Compare comp,
+           Arena* arena = nullptr) {
+  typedef typename std::iterator_traits<RandomIt>::value_type T;
+  ArenaScope scope(arena);
+  ScratchVector<T> left(first, middle, ArenaAllocator<T>(arena));
+  ScratchVector<T> right(middle, last, ArenaAllocator<T>(arena));
+  size_t i = 0, j = 0;
+  RandomIt pos = first;
+  while (i < left.size() && j < right.size()) {
+    if (comp(left[i], right[j])) {
+      *pos = left[i];
+      i++;
+    } else {
+      *pos = right[j];
+      j++;
+    }
+    ++pos;
+  }
+  pos = std::copy(left.begin() + i, left.end(), pos);
+  std::copy(right.begin() + j, right.end(), pos);
+}
+
+namespace detail {
+template <class RandomIt, class Compare>
+void mergeSort(RandomIt first, RandomIt last, Compare comp, Arena* arena,
+               std::false_type) {
+  if (last - first > 1) {
+    RandomIt middle = first + (last - first + 1) / 2;
+    mergeSort(first, middle, comp, arena, std::false_type());
+    mergeSort(middle, last, comp, arena, std::false_type());
+    merge(first, middle, last, comp, arena);
+  }
+}
+
+/** @brief mergeSort - merge sort of integer-keyed elements.
+ * Blocks of @ref kNetworkSize elements are sorted by sorting network, range
+ * is split at block boundary so only the last block is shorter.
+ */
+template <class RandomIt, class Compare>
+void mergeSort(RandomIt first, RandomIt last, Compare comp, Arena* arena,
+               std::true_type) {
+  size_t n = last - first;
+  if (n <= kNetworkSize) return networkSort(first, last);
+  size_t blocks = (n + kNetworkSize - 1) / kNetworkSize;
+  RandomIt middle = first + (blocks + 1) / 2 * kNetworkSize;
+  mergeSort(first, middle, comp, arena, std::true_type());
+  mergeSort(middle, last, comp, arena, std::true_type());
+  merge(first, middle, last, comp, arena);
+}
+}  // namespace detail
+
+/** @brief mergeSort - sorts given range sequentially.
+ * Elements with integer key consistent with comparator are sorted in blocks
+ * by sorting network, see @ref networkSort. Blocks are merged with @p comp.
+ * @param first   - beginning of range;
+ * @param last    - end of range;
+ * @param comp    - strict weak ordering of elements;
+ * @param arena   - arena for temporary copies, null means the heap.
+ */
+template <class RandomIt, class Compare>
+void mergeSort(RandomIt first, RandomIt last, Compare comp,
+               Arena* arena = nullptr) {
+  detail::mergeSort(
+      first, last, comp, arena,
+      std::integral_constant<bool,
+                             detail::HasSortKey<RandomIt, Compare>::value>());
+}
+
+/** @brief parallelMergeSort - sorts given range with workers from the pool.
+ * Range is split into ranges' tree with at most @p workers leafs. Leafs are
+ * sorted by workers and sibling nodes are merged as soon as both are ready.
+ * Single worker sorts on caller's thread.
+ * @param pool[in, out]   - pool executing the work;
+ * @param workers         - maximal number of leafs;
+ * @param first           - beginning of range;
+ * @param last            - end of range;
+ * @param comp            - strict weak ordering of elements;
+ * @param workspace       - scratch arenas, null means the heap.
+ */
+template <class RandomIt, class Compare>
+void parallelMergeSort(ThreadPool& pool, uint64_t workers, RandomIt first,
+                       RandomIt last, Compare comp,
+                       Workspace* workspace = nullptr) {
+  typedef std::pair<size_t, size_t> Range;
+  size_t n = last - first;
+  if (n < 2) return;
+  if (workers <= 1) return mergeSort(first, last, comp, localArena(workspace));
+  Arena* shared = sharedArena(workspace);
+  ArenaScope scope(shared);
+  // Node p of ranges' tree has children 2p and 2p + 1, node 0 is unused.
+  ScratchVector<Range> ranges{ArenaAllocator<Range>(shared)};
+  ranges.reserve(2 * workers);
+  ranges.push_back({0, 0});
+  ranges.push_back({0, n});
+  uint64_t leafs = 1;
+  size_t position = 1;
+  // Distributing the work to workers.
+  while (leafs < workers &&
+         ranges[position].second - ranges[position].first > 1) {
+    size_t m = ranges[position].first +
+               (ranges[position].second - ranges[position].first + 1) / 2;
+    ranges.push_back({ranges[position].first, m});
+    ranges.push_back({m, ranges[position].second});
+    leafs++;
+    position++;
+  }
+  ScratchVector<std::future<void>> futures{
+      ArenaAllocator<std::future<void>>(shared)};
+  futures.resize(ranges.size());
+  size_t k = ranges.size() - 1;
+  for (size_t i = k; i >= position; i--) {
+    RandomIt l = first + ranges[i].first, r = first + ranges[i].second;
+    TRACE_INSTANT("spawn sort", i);
+    futures[i] = pool.enqueue([l, r, comp, workspace]() {
+      TRACE_SCOPE("sort leaf", r - l);
+      mergeSort(l, r, comp, localArena(workspace));
+    });
+  }
+  // Merging sub results when it's possible.
+  for (size_t i = k; i > 1; i -= 2) {
+    {
+      TRACE_SCOPE("wait merge inputs", i / 2);
+      futures[i].get();
+      futures[i - 1].get();
+    }
+    RandomIt l = first + ranges[i - 1].first, m = first + ranges[i].first,
+             r = first + ranges[i].second;
+    // Merge level is depth of merged node in the ranges' tree.
+    TRACE_INSTANT("spawn merge level", 63 - __builtin_clzll(i / 2));
+    futures[i / 2] = pool.enqueue([l, m, r, comp, workspace]() {
+      TRACE_SCOPE("merge", r - l);
+      merge(l, m, r, comp, localArena(workspace));
+    });
+  }
+  // Waiting for result.
+  TRACE_SCOPE("wait sort", n);
+  futures[1].get();
+}
+
+}  // namespace engines
+
+#endif  // SRC_SORT_H_
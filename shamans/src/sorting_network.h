@@ -0,0 +1,160 @@
+#ifndef SRC_SORTING_NETWORK_H_
+#define SRC_SORTING_NETWORK_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace engines {
+
+/** @brief SortKey - trait exposing unsigned integer key of element.
+ * Specialization sets @p available and provides static get(element), such
+ * that a < b exactly when get(a) < get(b). Unsigned integers are their own
+ * keys.
+ */
+template <class T, class Enable = void>
+struct SortKey {
+  static const bool available = false;
+};
+
+template <class T>
+struct SortKey<T, typename std::enable_if<std::is_unsigned<T>::value>::type> {
+  static const bool available = true;
+  static uint64_t get(T const& value) { return value; }
+};
+
+/** @brief KeyLess - orders elements by their integer keys, consistent with
+ * std::less but without calling element's comparison operator.
+ */
+template <class T>
+struct KeyLess {
+  bool operator()(T const& a, T const& b) const {
+    return SortKey<T>::get(a) < SortKey<T>::get(b);
+  }
+};
+
+// Ranges up to this size are sorted by sorting network.
+const size_t kNetworkSize = 16;
+
+/** @brief Comparator - pair of positions ordered by sorting network.
+ */
+typedef std::pair<uint8_t, uint8_t> Comparator;
+
+/** @brief batcherNetwork - generates Batcher's odd-even merge sort network.
+ * Each comparator moves smaller element to lower position, so comparators
+ * touching positions from @p n on are dropped from the network of the next
+ * power of two. For 16 elements the network has 63 comparators.
+ * @param n   - number of sorted elements.
+ * @return Comparators in order of application.
+ */
+inline std::vector<Comparator> batcherNetwork(size_t n) {
+  std::vector<Comparator> network;
+  for (size_t p = 1; p < n; p *= 2) {
+    for (size_t k = p; k > 0; k /= 2) {
+      for (size_t j = k % p; j + k < n; j += 2 * k) {
+        for (size_t i = 0; i < std::min(k, n - j - k); i++) {
+          if ((i + j) / (2 * p) == (i + j + k) / (2 * p))
+            network.push_back(Comparator(i + j, i + j + k));
+        }
+      }
+    }
+  }
+  return network;
+}
+
+/** @brief compareExchange - orders two elements by keys without branches.
+ * Both elements are selected by the same condition, which compiles to
+ * conditional moves or vector blends.
+ * @param a[in, out]   - element at lower position;
+ * @param b[in, out]   - element at higher position.
+ */
+template <class T>
+inline void compareExchange(T& a, T& b) {
+  bool swap = SortKey<T>::get(b) < SortKey<T>::get(a);
+  T low = swap ? b : a;
+  T high = swap ? a : b;
+  a = low;
+  b = high;
+}
+
+namespace detail {
+// Network of @ref batcherNetwork for kNetworkSize elements, as a table so
+// that each compared position is a compile-time constant.
+constexpr uint8_t kNetwork[63][2] = {
+    {0, 1},   {2, 3},   {4, 5},   {6, 7},   {8, 9},   {10, 11}, {12, 13},
+    {14, 15}, {0, 2},   {1, 3},   {4, 6},   {5, 7},   {8, 10},  {9, 11},
+    {12, 14}, {13, 15}, {1, 2},   {5, 6},   {9, 10},  {13, 14}, {0, 4},
+    {1, 5},   {2, 6},   {3, 7},   {8, 12},  {9, 13},  {10, 14}, {11, 15},
+    {2, 4},   {3, 5},   {10, 12}, {11, 13}, {1, 2},   {3, 4},   {5, 6},
+    {9, 10},  {11, 12}, {13, 14}, {0, 8},   {1, 9},   {2, 10},  {3, 11},
+    {4, 12},  {5, 13},  {6, 14},  {7, 15},  {4, 8},   {5, 9},   {6, 10},
+    {7, 11},  {2, 4},   {3, 5},   {6, 8},   {7, 9},   {10, 12}, {11, 13},
+    {1, 2},   {3, 4},   {5, 6},   {7, 8},   {9, 10},  {11, 12}, {13, 14}};
+
+/** @brief NetworkStep - applies comparators from @p I on, unrolled by
+ * template recursion.
+ */
+template <size_t I, size_t Count = sizeof(kNetwork) / sizeof(kNetwork[0])>
+struct NetworkStep {
+  template <class RandomIt>
+  static void apply(RandomIt first) {
+    compareExchange(first[kNetwork[I][0]], first[kNetwork[I][1]]);
+    NetworkStep<I + 1, Count>::apply(first);
+  }
+
+  // Comparators touching positions from n on are skipped, positions past
+  // the range hold no element.
+  template <class RandomIt>
+  static void apply(RandomIt first, size_t n) {
+    if (kNetwork[I][1] < n)
+      compareExchange(first[kNetwork[I][0]], first[kNetwork[I][1]]);
+    NetworkStep<I + 1, Count>::apply(first, n);
+  }
+};
+
+template <size_t Count>
+struct NetworkStep<Count, Count> {
+  template <class RandomIt>
+  static void apply(RandomIt) {}
+
+  template <class RandomIt>
+  static void apply(RandomIt, size_t) {}
+};
+}  // namespace detail
+
+/** @brief networkSort - sorts small range of integer-keyed elements with
+ * sorting network. Sequence of compared positions depends only on the size
+ * of range, not on the keys, and is unrolled at compile time. Shorter
+ * ranges use comparators of the full network within the range. The sort
+ * isn't stable.
+ * @param first   - beginning of range;
+ * @param last    - end of range, at most @ref kNetworkSize elements.
+ */
+template <class RandomIt>
+void networkSort(RandomIt first, RandomIt last) {
+  size_t n = last - first;
+  if (n == kNetworkSize)
+    detail::NetworkStep<0>::apply(first);
+  else
+    detail::NetworkStep<0>::apply(first, n);
+}
+
+namespace detail {
+/** @brief HasSortKey - checks if ordering of range is ordering of keys.
+ * Key is consistent only with std::less ordering.
+ */
+template <class RandomIt, class Compare>
+struct HasSortKey {
+  typedef typename std::iterator_traits<RandomIt>::value_type T;
+  static const bool value = SortKey<T>::available &&
+                            std::is_same<Compare, std::less<T>>::value;
+};
+}  // namespace detail
+
+}  // namespace engines
+
+#endif  // SRC_SORTING_NETWORK_H_
@@ -0,0 +1,264 @@
+#ifndef SRC_SPARSE_KNAPSACK_H_
+#define SRC_SPARSE_KNAPSACK_H_
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+#include "./arena.h"
+#include "./knapsack.h"
+#include "./subset_sum.h"
+#include "./trace.h"
+
+namespace engines {
+
+/** @brief ParetoState - size and weight of some subset of items.
+ */
+struct ParetoState {
+  uint64_t size;
+  uint64_t weight;
+};
+
+/** @brief paretoFront - finds states not dominated by other ones.
+ * State is dominated if other state is not larger and not lighter. After
+ * each item current front is merged with its copy shifted by the item, both
+ * sorted by size, so front stays sorted by size and weight. With positive
+ * @p scale only the smallest state of weights with the same quotient by
+ * @p scale is kept, which loses less than @p scale per item.
+ * @param first             - beginning of items' range;
+ * @param last              - end of items' range;
+ * @param capacity          - capacity of knapsack;
+ * @param size              - functor providing item's size;
+ * @param weight            - functor providing item's weight;
+ * @param front[out]        - states sorted by size;
+ * @param buffer[in, out]   - scratch for merged states;
+ * @param scale             - width of weights' buckets, 0 keeps all states.
+ */
+template <class RandomIt, class SizeFn, class WeightFn>
+void paretoFront(RandomIt first, RandomIt last, uint64_t capacity,
+                 SizeFn size, WeightFn weight,
+                 ScratchVector<ParetoState>& front,
+                 ScratchVector<ParetoState>& buffer, double scale = 0) {
+  front.assign(1, {0, 0});
+  for (RandomIt it = first; it != last; ++it) {
+    uint64_t s = size(*it);
+    if (s > capacity) continue;
+    uint64_t w = weight(*it);
+    buffer.clear();
+    size_t i = 0, j = 0;
+    while (i < front.size() ||
+           (j < front.size() && front[j].size <= capacity - s)) {
+      ParetoState next;
+      bool shifted = j < front.size() && front[j].size <= capacity - s;
+      // Smaller size first, heavier state first on equal sizes.
+      if (i < front.size() &&
+          (!shifted || front[i].size < front[j].size + s ||
+           (front[i].size == front[j].size + s &&
+            front[i].weight >= front[j].weight + w))) {
+        next = front[i++];
+      } else {
+        next = {front[j].size + s, front[j].weight + w};
+        j++;
+      }
+      if (buffer.empty() ||
+          (scale > 0 ? std::floor(next.weight / scale) >
+                           std::floor(buffer.back().weight / scale)
+                     : next.weight > buffer.back().weight))
+        buffer.push_back(next);
+    }
+    front.swap(buffer);
+  }
+}
+
+/** @brief paretoKnapsack - solves discrete knapsack problem keeping only
+ * Pareto-optimal states. Time and memory depend on number of states, not on
+ * capacity.
+ * @param first      - beginning of items' range;
+ * @param last       - end of items' range;
+ * @param capacity   - capacity of knapsack;
+ * @param size       - functor providing item's size;
+ * @param weight     - functor providing item's weight;
+ * @param arena      - arena for states, null means the heap.
+ * @return Maximum possible weight of packed items.
+ */
+template <class RandomIt, class SizeFn, class WeightFn>
+uint64_t paretoKnapsack(RandomIt first, RandomIt last, uint64_t capacity,
+                        SizeFn size, WeightFn weight, Arena* arena = nullptr) {
+  TRACE_SCOPE("pareto knapsack", last - first);
+  ArenaScope scope(arena);
+  ScratchVector<ParetoState> front{ArenaAllocator<ParetoState>(arena)};
+  ScratchVector<ParetoState> buffer{ArenaAllocator<ParetoState>(arena)};
+  paretoFront(first, last, capacity, size, weight, front, buffer);
+  return front.back().weight;
+}
+
+/** @brief meetInTheMiddleKnapsack - solves discrete knapsack problem by
+ * joining Pareto fronts of two halves of items. Each front has at most
+ * 2^(n/2) states.
+ * @param first      - beginning of items' range;
+ * @param last       - end of items' range;
+ * @param capacity   - capacity of knapsack;
+ * @param size       - functor providing item's size;
+ * @param weight     - functor providing item's weight;
+ * @param arena      - arena for states, null means the heap.
+ * @return Maximum possible weight of packed items.
+ */
+template <class RandomIt, class SizeFn, class WeightFn>
+uint64_t meetInTheMiddleKnapsack(RandomIt first, RandomIt last,
+                                 uint64_t capacity, SizeFn size,
+                                 WeightFn weight, Arena* arena = nullptr) {
+  TRACE_SCOPE("meet in the middle knapsack", last - first);
+  ArenaScope scope(arena);
+  RandomIt middle = first + (last - first) / 2;
+  ScratchVector<ParetoState> left{ArenaAllocator<ParetoState>(arena)};
+  ScratchVector<ParetoState> right{ArenaAllocator<ParetoState>(arena)};
+  ScratchVector<ParetoState> buffer{ArenaAllocator<ParetoState>(arena)};
+  paretoFront(first, middle, capacity, size, weight, left, buffer);
+  paretoFront(middle, last, capacity, size, weight, right, buffer);
+  // Growing left state leaves less room, so best right state only shrinks.
+  uint64_t best = 0;
+  size_t j = right.size();
+  for (ParetoState const& state : left) {
+    while (j > 0 && right[j - 1].size > capacity - state.size) j--;
+    if (j == 0) break;
+    best = std::max(best, state.weight + right[j - 1].weight);
+  }
+  return best;
+}
+
+/** @brief KnapsackEngine - algorithms solving knapsack problem.
+ */
+enum class KnapsackEngine {
+  kAll,              // All items fit, no table needed.
+  kDense,            // Table over all capacities.
+  kPareto,           // Pareto-optimal states only.
+  kMeetInTheMiddle,  // Pareto fronts of halves joined together.
+  kSubsetSum         // Bitset of reachable sizes, weights are proportional.
+};
+
+// Dense tables larger than this are never allocated.
+const uint64_t kMaxDenseCells = 1ull << 27;
+// Sparse state costs more than dense cell.
+const double kSparseStateCost = 4;
+
+/** @brief knapsackWork - estimated work of algorithm in dense cells.
+ * Pareto front of i items has at most min(2^i, capacity + 1) states, fronts
+ * of halves at most 2^(n/2) states each. Bitset of reachable sizes packs 64
+ * capacities into a word.
+ * @param engine     - algorithm other than @ref KnapsackEngine::kAll;
+ * @param n          - number of items;
+ * @param capacity   - capacity of knapsack.
+ * @return Estimated work.
+ */
+inline double knapsackWork(KnapsackEngine engine, uint64_t n,
+                           uint64_t capacity) {
+  double columns = static_cast<double>(capacity) + 1;
+  switch (engine) {
+    case KnapsackEngine::kPareto: {
+      double pareto = 0;
+      for (uint64_t i = 1; i <= n; i++)
+        pareto +=
+            std::min(std::ldexp(1.0, std::min<uint64_t>(i, 1000)), columns);
+      return kSparseStateCost * pareto;
+    }
+    case KnapsackEngine::kMeetInTheMiddle: {
+      double half = std::ldexp(1.0, std::min<uint64_t>((n + 1) / 2, 1000));
+      return kSparseStateCost * (2 * half * ((n + 1) / 2) + 2 * half);
+    }
+    case KnapsackEngine::kSubsetSum:
+      return n * (std::floor(capacity / 64.0) + 1);
+    default:
+      return n * columns;
+  }
+}
+
+/** @brief chooseKnapsackEngine - picks algorithm with least estimated work,
+ * see @ref knapsackWork.
+ * @param first      - beginning of items' range;
+ * @param last       - end of items' range;
+ * @param capacity   - capacity of knapsack;
+ * @param size       - functor providing item's size;
+ * @param weight     - functor providing item's weight.
+ * @return Chosen algorithm.
+ */
+template <class RandomIt, class SizeFn, class WeightFn>
+KnapsackEngine chooseKnapsackEngine(RandomIt first, RandomIt last,
+                                    uint64_t capacity, SizeFn size,
+                                    WeightFn weight) {
+  uint64_t n = last - first;
+  // Space left by previous items is tracked, their sum could overflow.
+  uint64_t left = capacity;
+  RandomIt it = first;
+  for (; it != last; ++it) {
+    uint64_t s = size(*it);
+    if (s > left) break;
+    left -= s;
+  }
+  if (it == last) return KnapsackEngine::kAll;
+  double dense = knapsackWork(KnapsackEngine::kDense, n, capacity);
+  double pareto = knapsackWork(KnapsackEngine::kPareto, n, capacity);
+  double middle = knapsackWork(KnapsackEngine::kMeetInTheMiddle, n, capacity);
+  double words = std::floor(capacity / 64.0) + 1;
+  if (n * words <= std::min(std::min(dense, pareto), middle) &&
+      words <= kMaxDenseCells &&
+      proportionalWeights(first, last, size, weight))
+    return KnapsackEngine::kSubsetSum;
+  if (dense <= std::min(pareto, middle) && dense <= kMaxDenseCells)
+    return KnapsackEngine::kDense;
+  return pareto <= middle ? KnapsackEngine::kPareto
+                          : KnapsackEngine::kMeetInTheMiddle;
+}
+
+/** @brief solveKnapsack - solves knapsack problem with given algorithm.
+ * @param engine     - algorithm chosen by @ref chooseKnapsackEngine;
+ * @param first      - beginning of items' range;
+ * @param last       - end of items' range;
+ * @param capacity   - capacity of knapsack;
+ * @param size       - functor providing item's size;
+ * @param weight     - functor providing item's weight;
+ * @param arena      - arena for scratch memory, null means the heap.
+ * @return Maximum possible weight of packed items.
+ */
+template <class RandomIt, class SizeFn, class WeightFn>
+uint64_t solveKnapsack(KnapsackEngine engine, RandomIt first, RandomIt last,
+                       uint64_t capacity, SizeFn size, WeightFn weight,
+                       Arena* arena = nullptr) {
+  uint64_t result = 0;
+  switch (engine) {
+    case KnapsackEngine::kAll:
+      for (RandomIt it = first; it != last; ++it) result += weight(*it);
+      return result;
+    case KnapsackEngine::kPareto:
+      return paretoKnapsack(first, last, capacity, size, weight, arena);
+    case KnapsackEngine::kMeetInTheMiddle:
+      return meetInTheMiddleKnapsack(first, last, capacity, size, weight,
+                                     arena);
+    case KnapsackEngine::kSubsetSum:
+      return subsetSumKnapsack(first, last, capacity, size, weight, arena);
+    default:
+      return knapsack(first, last, capacity, size, weight, arena);
+  }
+}
+
+/** @brief autoKnapsack - solves knapsack problem with algorithm picked by
+ * @ref chooseKnapsackEngine.
+ * @param first      - beginning of items' range;
+ * @param last       - end of items' range;
+ * @param capacity   - capacity of knapsack;
+ * @param size       - functor providing item's size;
+ * @param weight     - functor providing item's weight;
+ * @param arena      - arena for scratch memory, null means the heap.
+ * @return Maximum possible weight of packed items.
+ */
+template <class RandomIt, class SizeFn, class WeightFn>
+uint64_t autoKnapsack(RandomIt first, RandomIt last, uint64_t capacity,
+                      SizeFn size, WeightFn weight, Arena* arena = nullptr) {
+  return solveKnapsack(
+      chooseKnapsackEngine(first, last, capacity, size, weight), first, last,
+      capacity, size, weight, arena);
+}
+
+}  // namespace engines
+
+#endif  // SRC_SPARSE_KNAPSACK_H_
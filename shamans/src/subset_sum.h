@@ -0,0 +1,208 @@
+#ifndef SRC_SUBSET_SUM_H_
+#define SRC_SUBSET_SUM_H_
+
+#include <algorithm>
+#include <future>
+#include <vector>
+
+#include "../third_party/threadpool/threadpool.h"
+
+#include "./arena.h"
+#include "./knapsack.h"
+#include "./parallel.h"
+#include "./trace.h"
+
+namespace engines {
+
+// Parallel subset sum keeps bitset of each item, larger tables are not
+// allocated and the work is done sequentially.
+const uint64_t kMaxSubsetSumTableWords = 1ull << 24;
+
+/** @brief proportionalWeights - checks if weight of each item is the same
+ * multiple of its size, then knapsack reduces to subset sum.
+ * @param first   - beginning of items' range;
+ * @param last    - end of items' range;
+ * @param size    - functor providing item's size;
+ * @param weight  - functor providing item's weight.
+ * @return True if weights are proportional to sizes.
+ */
+template <class RandomIt, class SizeFn, class WeightFn>
+bool proportionalWeights(RandomIt first, RandomIt last, SizeFn size,
+                         WeightFn weight) {
+  uint64_t sizeUnit = 0, weightUnit = 0;
+  for (RandomIt it = first; it != last; ++it) {
+    uint64_t s = size(*it), w = weight(*it);
+    if (sizeUnit == 0 && s != 0) {
+      sizeUnit = s;
+      weightUnit = w;
+    }
+    if (static_cast<unsigned __int128>(w) * sizeUnit !=
+        static_cast<unsigned __int128>(s) * weightUnit)
+      return false;
+    // Weight of item without size can't be compared with reference item.
+    if (s == 0 && w != 0) return false;
+  }
+  return true;
+}
+
+/** @brief subsetSumRow - adds item to bitset of reachable sums.
+ * Bit k of word w is sum 64 * w + k. Sums reachable with the item are
+ * previous sums shifted by item's size.
+ * @param prev[in]   - sums reachable without the item;
+ * @param row[out]   - sums reachable with the item;
+ * @param begin      - index of first filled word;
+ * @param end        - index after last filled word;
+ * @param shift      - item's size.
+ */
+inline void subsetSumRow(uint64_t const* __restrict prev,
+                         uint64_t* __restrict row, size_t begin, size_t end,
+                         uint64_t shift) {
+  uint64_t q = shift / 64;
+  unsigned r = shift % 64;
+  size_t w = begin;
+  // Words below the shift get at most lowest word shifted.
+  for (; w < end && w <= q; w++)
+    row[w] = prev[w] | (w == q ? prev[0] << r : 0);
+  if (r == 0) {
+    for (; w < end; w++) row[w] = prev[w] | prev[w - q];
+  } else {
+    for (; w < end; w++)
+      row[w] = prev[w] | (prev[w - q] << r) | (prev[w - q - 1] >> (64 - r));
+  }
+}
+
+/** @brief largestSum - finds largest reachable sum.
+ * @param bits[in]   - bitset of reachable sums, sum 0 must be reachable;
+ * @param capacity   - largest allowed sum.
+ * @return Largest reachable sum not exceeding capacity.
+ */
+inline uint64_t largestSum(uint64_t const* bits, uint64_t capacity) {
+  size_t w = capacity / 64;
+  uint64_t word = bits[w];
+  if (capacity % 64 != 63) word &= (2ull << (capacity % 64)) - 1;
+  while (word == 0) word = bits[--w];
+  return 64 * w + 63 - __builtin_clzll(word);
+}
+
+/** @brief subsetSumWeight - converts sum of sizes to sum of weights.
+ * @return Weight of items with given total size.
+ */
+template <class RandomIt, class SizeFn, class WeightFn>
+uint64_t subsetSumWeight(RandomIt first, RandomIt last, uint64_t sum,
+                         SizeFn size, WeightFn weight) {
+  for (RandomIt it = first; it != last; ++it) {
+    uint64_t s = size(*it);
+    if (s != 0)
+      return static_cast<unsigned __int128>(sum) * weight(*it) / s;
+  }
+  return 0;
+}
+
+/** @brief subsetSumKnapsack - solves knapsack problem of items with weights
+ * proportional to sizes. Reachable sums of sizes are kept as bits, so each
+ * machine word processes 64 capacities at once.
+ * @param first      - beginning of items' range;
+ * @param last       - end of items' range;
+ * @param capacity   - capacity of knapsack;
+ * @param size       - functor providing item's size;
+ * @param weight     - functor providing item's weight;
+ * @param arena      - arena for bitsets, null means the heap.
+ * @return Maximum possible weight of packed items.
+ */
+template <class RandomIt, class SizeFn, class WeightFn>
+uint64_t subsetSumKnapsack(RandomIt first, RandomIt last, uint64_t capacity,
+                           SizeFn size, WeightFn weight,
+                           Arena* arena = nullptr) {
+  TRACE_SCOPE("subset sum", last - first);
+  size_t words = capacity / 64 + 1;
+  ArenaScope scope(arena);
+  ScratchVector<uint64_t> prev(words, 0, ArenaAllocator<uint64_t>(arena));
+  ScratchVector<uint64_t> row(words, 0, ArenaAllocator<uint64_t>(arena));
+  prev[0] = 1;
+  for (RandomIt it = first; it != last; ++it) {
+    uint64_t s = size(*it);
+    if (s == 0 || s > capacity) continue;
+    subsetSumRow(prev.data(), row.data(), 0, words, s);
+    prev.swap(row);
+  }
+  return subsetSumWeight(first, last, largestSum(prev.data(), capacity), size,
+                         weight);
+}
+
+/** @brief subsetSumWords - partially fills bitsets of reachable sums.
+ * Like @ref knapsackColumns worker fills its words of each row, when
+ * previous worker finished the row.
+ * @param progress[in, out]   - rows finished by each worker;
+ * @param sizes[in]           - staged sizes of items;
+ * @param n                   - number of items;
+ * @param bits[in, out]       - bitsets, row 0 holds empty set;
+ * @param words               - length of bitset;
+ * @param beg                 - index of first word;
+ * @param end                 - index after last word;
+ * @param num                 - number of worker.
+ */
+inline void subsetSumWords(RowProgress* progress, uint64_t const* sizes,
+                           size_t n, uint64_t* bits, size_t words, size_t beg,
+                           size_t end, uint64_t num) {
+  TRACE_SCOPE("subset sum worker", num);
+  for (size_t i = 1; i <= n; i++) {
+    if (num != 0) progress[num - 1].await(i);
+    subsetSumRow(bits + (i - 1) * words, bits + i * words, beg, end,
+                 sizes[i - 1]);
+    progress[num].finish(i);
+  }
+}
+
+/** @brief parallelSubsetSumKnapsack - solves knapsack problem of items with
+ * weights proportional to sizes with workers from the pool. Each worker
+ * fills its block of bitsets' words item by item.
+ * @param pool[in, out]   - pool executing the work;
+ * @param workers         - number of words' blocks;
+ * @param first           - beginning of items' range;
+ * @param last            - end of items' range;
+ * @param capacity        - capacity of knapsack;
+ * @param size            - functor providing item's size;
+ * @param weight          - functor providing item's weight;
+ * @param workspace       - scratch arenas, null means the heap.
+ * @return Maximum possible weight of packed items.
+ */
+template <class RandomIt, class SizeFn, class WeightFn>
+uint64_t parallelSubsetSumKnapsack(ThreadPool& pool, uint64_t workers,
+                                   RandomIt first, RandomIt last,
+                                   uint64_t capacity, SizeFn size,
+                                   WeightFn weight,
+                                   Workspace* workspace = nullptr) {
+  size_t n = last - first;
+  size_t words = capacity / 64 + 1;
+  workers = std::max<uint64_t>(1, std::min<uint64_t>(workers, words));
+  if (workers == 1 || n == 0 || (n + 1) * words > kMaxSubsetSumTableWords)
+    return subsetSumKnapsack(first, last, capacity, size, weight,
+                             localArena(workspace));
+  Arena* shared = sharedArena(workspace);
+  ArenaScope scope(shared);
+  ScratchVector<uint64_t> sizes{ArenaAllocator<uint64_t>(shared)};
+  sizes.reserve(n);
+  for (RandomIt it = first; it != last; ++it) sizes.push_back(size(*it));
+  ScratchVector<uint64_t> bits((n + 1) * words, 0,
+                               ArenaAllocator<uint64_t>(shared));
+  bits[0] = 1;
+  ScratchArray<RowProgress> progress(workers, shared);
+  ScratchVector<std::future<void>> done{
+      ArenaAllocator<std::future<void>>(shared)};
+  done.reserve(workers);
+  std::vector<size_t> bounds = chunkBounds(words, workers);
+  for (uint64_t i = 0; i < workers; i++) {
+    TRACE_INSTANT("spawn subset sum", i);
+    done.push_back(pool.enqueue(subsetSumWords, progress.data(), sizes.data(),
+                                n, bits.data(), words, bounds[i],
+                                bounds[i + 1], i));
+  }
+  TRACE_SCOPE("wait subset sum", n);
+  for (auto& future : done) future.get();
+  return subsetSumWeight(first, last, largestSum(&bits[n * words], capacity),
+                         size, weight);
+}
+
+}  // namespace engines
+
+#endif  // SRC_SUBSET_SUM_H_
@@ -1,4 +1,9 @@
+#include <unistd.h>
+
+#include <cstdio>
 #include <iostream>
+#include <stdexcept>
+#include <string>
 
 #include "../adventure.h"
 #include "../utils.h"
@@ -53,6 +58,125 @@ void testCase5(Adventure &adventure) {
   correctnessTest(eggs, BottomlessBag(2000), 12079, adventure);
 }
 
+void testCase6(Adventure &adventure) {
+  std::vector<std::vector<Egg>> eggs;
+  std::vector<BottomlessBag> bags;
+  std::vector<uint64_t> expected;
+  for (int i = 0; i < 10; ++i) {
+    eggs.push_back({Egg(1, 1), Egg(2, 2), Egg(3, 3)});
+    bags.push_back(BottomlessBag(i));
+    expected.push_back(std::min(i, 6));
+  }
+  eggs.push_back({});
+  bags.push_back(BottomlessBag(5));
+  expected.push_back(0);
+  eggs.push_back({});
+  for (int i = 0; i < 33; ++i) eggs.back().push_back(Egg(i, i * i + 7));
+  bags.push_back(BottomlessBag(100));
+  expected.push_back(2969);
+  std::vector<PackingInstance> instances;
+  for (size_t i = 0; i < eggs.size(); ++i)
+    instances.push_back(PackingInstance(eggs[i], bags[i]));
+  adventure.packEggsBatch(instances);
+  for (size_t i = 0; i < instances.size(); ++i)
+    assert_eq_msg(instances[i].result, expected[i],
+                  "Unexpected batch packing result");
+}
+
+// Dense table over capacity would never fit into memory.
+void testCase7(Adventure &adventure) {
+  std::vector<Egg> eggs;
+  for (int i = 0; i < 40; ++i) eggs.push_back(Egg(100000000 + i, i + 1));
+
+  correctnessTest(eggs, BottomlessBag(1000000000), 324, adventure);
+  correctnessTest(eggs, BottomlessBag(5000000000ull), 820, adventure);
+}
+
+// Approximate packing stays within relative error of exact packing.
+void testCase8(Adventure &adventure) {
+  std::vector<Egg> eggs;
+  for (int i = 0; i < 60; ++i)
+    eggs.push_back(Egg((i * 7919) % 5000 + 100, (i * 104729) % 997 + 1));
+  BottomlessBag bag(40000);
+  uint64_t exact = adventure.packEggs(eggs, bag);
+  for (double epsilon : {0.0, 0.05, 0.3}) {
+    engines::ApproximateWeight result = adventure.packEggs(eggs, bag, epsilon);
+    assert_msg(result.weight <= exact && exact <= result.bound,
+               "Exact result should be between approximation and bound");
+    assert_msg(result.weight >= (1 - epsilon) * exact,
+               "Approximation should be within relative error");
+  }
+}
+
+// Eggs added in steps give the same results as packing all of them.
+void testSession(Adventure &adventure) {
+  PackingSession session(100);
+  std::vector<Egg> all;
+  for (int step = 0; step < 5; ++step) {
+    std::vector<Egg> eggs;
+    for (int i = 0; i < 7; ++i)
+      eggs.push_back(Egg((step * 7 + i) % 23 + 1, i * step + 3));
+    session.addEggs(eggs);
+    all.insert(all.end(), eggs.begin(), eggs.end());
+    for (uint64_t capacity : {0, 1, 17, 55, 100}) {
+      BottomlessBag bag(capacity);
+      assert_eq_msg(session.packEggs(bag), adventure.packEggs(all, bag),
+                    "Unexpected session packing result");
+    }
+  }
+  BottomlessBag tooLarge(101);
+  bool thrown = false;
+  try {
+    session.packEggs(tooLarge);
+  } catch (std::out_of_range const &) {
+    thrown = true;
+  }
+  assert_msg(thrown, "Bag above session's maximum should be rejected");
+  session.clear();
+  BottomlessBag bag(100);
+  assert_eq_msg(session.packEggs(bag), 0, "Cleared session should be empty");
+}
+
+void testColumns(Adventure &adventure) {
+  std::string path = "/tmp/bottomlessBagXXXXXX";
+  int fd = mkstemp(&path[0]);
+  assert_msg(fd >= 0, "Can't create temporary file");
+  close(fd);
+  std::vector<Egg> eggs;
+  {
+    engines::MappedColumns file = engines::MappedColumns::create(
+        path, engines::ColumnarKind::kEggs, 200);
+    engines::Span<uint64_t> sizes = file.mutableColumn(0);
+    engines::Span<uint64_t> weights = file.mutableColumn(1);
+    for (uint64_t i = 0; i < sizes.size(); i++) {
+      sizes[i] = (i * 7919) % 300 + 1;
+      weights[i] = (i * 104729) % 997;
+      eggs.push_back(Egg(sizes[i], weights[i]));
+    }
+  }
+  engines::MappedColumns file(path, false);
+  TeamAdventure *team = dynamic_cast<TeamAdventure *>(&adventure);
+  if (team != nullptr) team->touchColumns(file);
+  for (uint64_t capacity : {0, 1, 500, 5000}) {
+    BottomlessBag bag(capacity);
+    assert_eq_msg(adventure.packEggs(file.column(0), file.column(1), bag),
+                  adventure.packEggs(eggs, bag),
+                  "Wrong packing of mapped eggs");
+  }
+  engines::Span<uint64_t const> weights = file.column(1);
+  bool thrown = false;
+  try {
+    BottomlessBag bag(500);
+    adventure.packEggs(file.column(0),
+                       engines::Span<uint64_t const>(weights.data(), 199),
+                       bag);
+  } catch (std::invalid_argument const &) {
+    thrown = true;
+  }
+  assert_msg(thrown, "Columns of different lengths should be rejected");
+  std::remove(path.c_str());
+}
+
 int main(int argc, char **argv) {
   for (std::shared_ptr<Adventure> adventure :
        std::vector<std::shared_ptr<Adventure> >{
@@ -67,6 +191,11 @@ int main(int argc, char **argv) {
       testCase1(*adventure);
       testCase2(*adventure);
       testCase3(*adventure);
+      testCase6(*adventure);
+      testCase7(*adventure);
+      testCase8(*adventure);
+      testSession(*adventure);
+      testColumns(*adventure);
       // });
     } else {
       // runAndPrintDuration([&adventure]() {
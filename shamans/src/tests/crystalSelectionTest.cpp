@@ -1,5 +1,10 @@
+#include <unistd.h>
+
+#include <cstdio>
 #include <iostream>
 #include <memory>
+#include <stdexcept>
+#include <string>
 #include <vector>
 
 #include "../adventure.h"
@@ -33,6 +38,75 @@ void testCase1(Adventure &adventure) {
   runAndVerify(adventure, t5, r5);
 }
 
+void testCase2(Adventure &adventure) {
+  std::string path = "/tmp/crystalSelectionXXXXXX";
+  int fd = mkstemp(&path[0]);
+  assert_msg(fd >= 0, "Can't create temporary file");
+  close(fd);
+  bool thrown = false;
+  try {
+    engines::MappedColumns empty(path, false);
+  } catch (std::runtime_error const &) {
+    thrown = true;
+  }
+  assert_msg(thrown, "Empty file isn't columnar");
+  {
+    engines::MappedColumns file = engines::MappedColumns::create(
+        path, engines::ColumnarKind::kCrystals, 1000);
+    engines::Span<uint64_t> shininess = file.mutableColumn(0);
+    for (uint64_t i = 0; i < shininess.size(); i++)
+      shininess[i] = (i * 7919) % 1000;
+  }
+  engines::MappedColumns file(path, false);
+  assert_msg(file.kind() == engines::ColumnarKind::kCrystals,
+             "Wrong kind of columnar file");
+  thrown = false;
+  try {
+    file.mutableColumn(0);
+  } catch (std::runtime_error const &) {
+    thrown = true;
+  }
+  assert_msg(thrown, "Read-only column shouldn't be writable");
+  Crystal crystal =
+      adventure.selectBestCrystal(engines::columnView<Crystal>(file, 0));
+  assert_msg(crystal == Crystal(999), "Wrong mapped crystal selection");
+  std::remove(path.c_str());
+}
+
+void testCase3(Adventure &adventure) {
+  std::vector<Crystal> crystals;
+  for (uint64_t i = 0; i < 5000; i++)
+    crystals.push_back(Crystal(i * 37 % 1000));
+  assert_eq_msg(adventure.selectBestCrystalIndex(crystals), 27,
+                "Wrong index of best crystal");
+  std::vector<Crystal> top = adventure.selectTopCrystals(crystals, 7);
+  assert_eq_msg(top.size(), 7, "Wrong number of top crystals");
+  // Each shininess appears five times.
+  for (size_t i = 0; i < top.size(); i++)
+    assert_eq_msg(top[i].getShininess(), 999 - i / 5, "Wrong top crystal");
+  assert_eq_msg(adventure.selectTopCrystals(crystals, 9000).size(), 5000,
+                "Top of all crystals should return all of them");
+  assert_msg(adventure.selectTopCrystals(crystals, 0).empty(),
+             "No top crystals expected");
+}
+
+void testStrategy(Adventure &adventure, CrystalStrategy strategy) {
+  adventure.setCrystalStrategy(strategy);
+  TeamAdventure *team = dynamic_cast<TeamAdventure *>(&adventure);
+  calibration::Tuning tuning;
+  if (team != nullptr) {
+    tuning = team->getTuning();
+    // Free tasks make the team split selections among shamans.
+    calibration::Tuning parallel = tuning;
+    parallel.taskNs = 0;
+    team->setTuning(parallel);
+  }
+  testCase1(adventure);
+  testCase3(adventure);
+  adventure.setCrystalStrategy(CrystalStrategy::kCompare);
+  if (team != nullptr) team->setTuning(tuning);
+}
+
 int main(int argc, char **argv) {
     for (std::shared_ptr<Adventure> adventure :
          std::vector<std::shared_ptr<Adventure> >{
@@ -45,6 +119,10 @@ int main(int argc, char **argv) {
         if (argc == 1) {
       // runAndPrintDuration([&adventure]() {
       testCase1(*adventure);
+      testCase2(*adventure);
+      testCase3(*adventure);
+      testStrategy(*adventure, CrystalStrategy::kCompare);
+      testStrategy(*adventure, CrystalStrategy::kCachedKeys);
       // });
     } else {
       std::vector<Crystal> t2(2575757);
@@ -0,0 +1,857 @@
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <limits>
+#include <map>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "../adventure.h"
+#include "../approximate_knapsack.h"
+#include "../arena.h"
+#include "../cached_keys.h"
+#include "../calibration.h"
+#include "../intro_sort.h"
+#include "../knapsack.h"
+#include "../max_plus_knapsack.h"
+#include "../packing.h"
+#include "../radix_sort.h"
+#include "../run_sort.h"
+#include "../selection.h"
+#include "../sort.h"
+#include "../sorting_network.h"
+#include "../sparse_knapsack.h"
+#include "../trace.h"
+#include "../utils.h"
+
+struct Record {
+  uint64_t key;
+  uint64_t payload;
+};
+
+struct ByKey {
+  bool operator()(Record const& a, Record const& b) const {
+    return a.key < b.key;
+  }
+};
+
+struct PairSize {
+  uint64_t operator()(std::pair<uint64_t, uint64_t> const& p) const {
+    return p.first;
+  }
+};
+
+struct PairWeight {
+  uint64_t operator()(std::pair<uint64_t, uint64_t> const& p) const {
+    return p.second;
+  }
+};
+
+void testCase1(ThreadPool &pool, uint64_t workers) {
+  std::vector<int> t1(1000);
+  std::generate(t1.begin(), t1.end(), std::rand);
+  std::vector<int> r1 = t1;
+  std::sort(r1.begin(), r1.end(), std::greater<int>());
+  engines::parallelMergeSort(pool, workers, t1.begin(), t1.end(),
+                             std::greater<int>());
+  assert_msg(t1 == r1, "Wrong parallel sort of ints");
+
+  int t2[] = {5, 3, 9, 1, 7};
+  engines::mergeSort(t2 + 1, t2 + 4, std::less<int>());
+  assert_msg(t2[0] == 5 && t2[1] == 1 && t2[2] == 3 && t2[3] == 9 &&
+                 t2[4] == 7,
+             "Wrong sort of sub range");
+}
+
+void testCase2(ThreadPool &pool, uint64_t workers) {
+  std::vector<Record> t1;
+  for (uint64_t i = 0; i < 777; ++i) t1.push_back({(i * 31) % 777, i});
+  auto best = engines::parallelMaxElement(pool, workers, t1.begin(), t1.end(),
+                                          ByKey());
+  assert_eq_msg(best->key, 776, "Wrong max key");
+  assert_eq_msg(best - t1.begin(), engines::maxElement(t1.begin(), t1.end(),
+                                                       ByKey()) -
+                                       t1.begin(),
+                "Wrong max position");
+  assert_msg(engines::parallelMaxElement(pool, workers, t1.begin(),
+                                         t1.begin(), ByKey()) == t1.begin(),
+             "Empty range has no max");
+}
+
+void testCase3(ThreadPool &pool, uint64_t workers) {
+  std::vector<std::pair<uint64_t, uint64_t>> items{{5, 99999}, {1, 1}, {2, 2},
+                                                   {3, 3}, {1, 99999}};
+  uint64_t capacities[] = {1, 3, 5, 6};
+  uint64_t results[] = {99999, 99999 + 2, 99999 + 4, 2 * 99999};
+  for (int i = 0; i < 4; ++i) {
+    assert_eq_msg(engines::knapsack(items.begin(), items.end(), capacities[i],
+                                    PairSize(), PairWeight()),
+                  results[i], "Unexpected sequential packing result");
+    assert_eq_msg(
+        engines::parallelKnapsack(pool, workers, items.begin(), items.end(),
+                                  capacities[i], PairSize(), PairWeight()),
+        results[i], "Unexpected parallel packing result");
+  }
+  // Items are staged once, not read by each row of each worker.
+  std::atomic<uint64_t> calls(0);
+  auto countingWeight = [&calls](std::pair<uint64_t, uint64_t> const &p) {
+    calls++;
+    return p.second;
+  };
+  engines::parallelKnapsack(pool, workers, items.begin(), items.end(), 6,
+                            PairSize(), countingWeight);
+  assert_eq_msg(calls, items.size(), "Weight should be read once per item");
+}
+
+void testItemParallel(ThreadPool &pool, uint64_t workers) {
+  uint64_t seed = 7;
+  for (int round = 0; round < 40; ++round) {
+    std::vector<std::pair<uint64_t, uint64_t>> items;
+    for (int i = 0; i < round; ++i) {
+      seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+      // Heavy items in later rounds need wider cells.
+      uint64_t heaviest = round < 20 ? 50 : 1ull << 20;
+      items.push_back({(seed >> 33) % 9, (seed >> 40) % heaviest});
+    }
+    uint64_t capacity = round % 13;
+    uint64_t expected = engines::knapsack(items.begin(), items.end(), capacity,
+                                          PairSize(), PairWeight());
+    for (uint64_t groups : {workers, workers + 3}) {
+      assert_eq_msg(engines::itemParallelKnapsack(pool, groups, items.begin(),
+                                                  items.end(), capacity,
+                                                  PairSize(), PairWeight()),
+                    expected, "Wrong item parallel knapsack");
+    }
+  }
+}
+
+struct CountingLess {
+  explicit CountingLess(std::atomic<uint64_t> *callsArg) : calls(callsArg) {}
+
+  bool operator()(Record const &a, Record const &b) const {
+    (*calls)++;
+    return a.key < b.key;
+  }
+
+  std::atomic<uint64_t> *calls;
+};
+
+void testRunSort(ThreadPool &pool, uint64_t workers) {
+  std::atomic<uint64_t> calls(0);
+  for (size_t n : {0, 1, 2, 31, 32, 33, 1000, 5000}) {
+    // Random keys with many duplicates, payload checks stability.
+    std::vector<Record> t1;
+    for (size_t i = 0; i < n; ++i) t1.push_back({std::rand() % 100ull, i});
+    // Sorted set with appended grains, and reversed set.
+    std::vector<Record> t2 = t1;
+    std::stable_sort(t2.begin(), t2.begin() + n * 9 / 10, ByKey());
+    std::vector<Record> t3 = t1;
+    std::stable_sort(t3.begin(), t3.end(), ByKey());
+    std::vector<Record> expected = t3;
+    for (size_t i = 0; i < n; ++i) t3[i].key = n - i;
+    for (std::vector<Record> *t : {&t1, &t2, &t3}) {
+      std::vector<Record> reference = *t;
+      std::stable_sort(reference.begin(), reference.end(), ByKey());
+      std::vector<Record> sequential = *t;
+      engines::runSort(sequential.begin(), sequential.end(), ByKey());
+      engines::parallelRunSort(pool, workers, t->begin(), t->end(), ByKey());
+      for (size_t i = 0; i < n; ++i) {
+        assert_msg(sequential[i].key == reference[i].key &&
+                       sequential[i].payload == reference[i].payload,
+                   "Wrong run sort");
+        assert_msg((*t)[i].key == reference[i].key &&
+                       (*t)[i].payload == reference[i].payload,
+                   "Wrong parallel run sort");
+      }
+    }
+    // Sorted input is only scanned.
+    calls = 0;
+    engines::runSort(expected.begin(), expected.end(), CountingLess(&calls));
+    assert_msg(calls + 1 <= std::max<size_t>(n, 1),
+               "Sorted input should cost n - 1 comparisons");
+    calls = 0;
+    engines::parallelRunSort(pool, workers, expected.begin(), expected.end(),
+                             CountingLess(&calls));
+    assert_msg(calls + 2 <= 2 * std::max<size_t>(n, 1),
+               "Sorted input should be scanned twice");
+  }
+}
+
+void testTopElements(ThreadPool &pool, uint64_t workers) {
+  for (size_t n : {0, 1, 7, 100, 3000}) {
+    std::vector<uint64_t> t1(n);
+    for (auto &v : t1) v = std::rand() % (n / 3 + 1);
+    // Largest first, earlier first among equal elements.
+    std::vector<size_t> order(n);
+    for (size_t i = 0; i < n; i++) order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&t1](size_t a, size_t b) {
+      return t1[b] < t1[a];
+    });
+    for (size_t k : {size_t(0), size_t(1), size_t(5), n, n + 3}) {
+      auto top = engines::topElements(t1.begin(), t1.end(), k,
+                                      std::less<uint64_t>());
+      auto parallel = engines::parallelTopElements(
+          pool, workers, t1.begin(), t1.end(), k, std::less<uint64_t>());
+      assert_eq_msg(top.size(), std::min(k, n), "Wrong number of top elements");
+      assert_msg(top == parallel, "Parallel top elements differ");
+      for (size_t i = 0; i < top.size(); i++)
+        assert_eq_msg(top[i] - t1.begin(), order[i], "Wrong top element");
+    }
+  }
+}
+
+uint64_t grainComparisons = 0;
+
+/** @brief KeyedGrain - element with sort key, counting its comparisons.
+ */
+struct KeyedGrain {
+  uint64_t key;
+
+  bool operator<(KeyedGrain const &other) const {
+    grainComparisons++;
+    return key < other.key;
+  }
+};
+
+namespace engines {
+template <>
+struct SortKey<KeyedGrain> {
+  static const bool available = true;
+  static uint64_t get(KeyedGrain const &keyed) { return keyed.key; }
+};
+}  // namespace engines
+
+void testSortingNetwork(ThreadPool &pool, uint64_t workers) {
+  // Network sorting all sequences of zeros and ones sorts everything.
+  for (size_t n = 0; n <= engines::kNetworkSize; n++) {
+    for (uint64_t mask = 0; mask < (1ull << n); mask++) {
+      std::vector<uint64_t> bits(n);
+      for (size_t i = 0; i < n; i++) bits[i] = (mask >> i) & 1;
+      engines::networkSort(bits.begin(), bits.end());
+      assert_msg(std::is_sorted(bits.begin(), bits.end()),
+                 "Sorting network doesn't sort");
+    }
+  }
+  std::vector<engines::Comparator> network =
+      engines::batcherNetwork(engines::kNetworkSize);
+  assert_eq_msg(network.size(), 63, "Wrong size of sorting network");
+  for (size_t i = 0; i < network.size(); i++)
+    assert_msg(network[i].first == engines::detail::kNetwork[i][0] &&
+                   network[i].second == engines::detail::kNetwork[i][1],
+               "Unrolled network differs from Batcher's network");
+  for (size_t n : {0, 1, 15, 16, 17, 33, 100, 5000}) {
+    std::vector<uint64_t> t1(n);
+    for (auto &v : t1) v = std::rand() % (n / 2 + 1);
+    std::vector<uint64_t> r1 = t1, t2 = t1;
+    std::sort(r1.begin(), r1.end());
+    engines::mergeSort(t1.begin(), t1.end(), std::less<uint64_t>());
+    assert_msg(t1 == r1, "Wrong merge sort with network blocks");
+    engines::parallelMergeSort(pool, workers, t2.begin(), t2.end(),
+                               std::less<uint64_t>());
+    assert_msg(t2 == r1, "Wrong parallel merge sort with network blocks");
+  }
+  // Network sorts blocks by keys, blocks are merged with the comparator.
+  std::vector<KeyedGrain> keyed;
+  for (uint64_t i = 0; i < 100; i++) keyed.push_back({(i * 37) % 100});
+  grainComparisons = 0;
+  engines::mergeSort(keyed.begin(), keyed.end(), std::less<KeyedGrain>());
+  for (uint64_t i = 0; i < 100; i++)
+    assert_eq_msg(keyed[i].key, i, "Wrong merge sort of keyed elements");
+  assert_msg(grainComparisons > 0, "Merges should call the comparator");
+}
+
+void testIntroSort(ThreadPool &pool, uint64_t workers) {
+  for (size_t n : {0, 1, 2, 16, 17, 129, 1000, 20000}) {
+    for (uint64_t range : {1ull, 2ull, 5ull, 100ull, 1ull << 40}) {
+      std::vector<uint64_t> t1(n);
+      for (auto &v : t1)
+        v = ((static_cast<uint64_t>(std::rand()) << 31) ^ std::rand()) % range;
+      // Random, sorted, reversed and organ pipe inputs.
+      std::vector<uint64_t> t2 = t1;
+      std::sort(t2.begin(), t2.end());
+      std::vector<uint64_t> t3(t2.rbegin(), t2.rend());
+      std::vector<uint64_t> t4 = t2;
+      std::reverse(t4.begin() + n / 2, t4.end());
+      for (std::vector<uint64_t> *t : {&t1, &t2, &t3, &t4}) {
+        std::vector<uint64_t> sequential = *t;
+        engines::introSort(sequential.begin(), sequential.end(),
+                           std::less<uint64_t>());
+        assert_msg(sequential == t2, "Wrong intro sort");
+        engines::parallelIntroSort(pool, workers, t->begin(), t->end(),
+                                   std::less<uint64_t>());
+        assert_msg(*t == t2, "Wrong parallel intro sort");
+      }
+    }
+  }
+  // Pivot of sorted input is its median, so partitions are balanced.
+  std::atomic<uint64_t> calls(0);
+  for (size_t n : {20, 64, 100, 128, 129, 1000}) {
+    std::vector<Record> sorted;
+    for (size_t i = 0; i < n; ++i) sorted.push_back({i, i});
+    calls = 0;
+    engines::introSort(sorted.begin(), sorted.end(), CountingLess(&calls));
+    assert_msg(calls <= n * std::log2(n),
+               "Sorted input should cost at most n log2 n comparisons");
+  }
+}
+
+void testCellWidths(ThreadPool &pool, uint64_t workers) {
+  // Totals at the limits of 16 and 32 bit cells.
+  for (uint64_t total : {65535ull, 65536ull, 4294967295ull, 4294967296ull,
+                         1ull << 63}) {
+    std::vector<std::pair<uint64_t, uint64_t>> items{
+        {3, total / 2}, {2, total - total / 2 - 1}, {1, 1}};
+    assert_eq_msg(engines::knapsack(items.begin(), items.end(), 6, PairSize(),
+                                    PairWeight()),
+                  total, "Wrong knapsack near cell limit");
+    assert_eq_msg(engines::knapsack(items.begin(), items.end(), 5, PairSize(),
+                                    PairWeight()),
+                  total - 1, "Wrong knapsack near cell limit");
+    assert_eq_msg(
+        engines::parallelKnapsack(pool, workers, items.begin(), items.end(), 5,
+                                  PairSize(), PairWeight()),
+        total - 1, "Wrong parallel knapsack near cell limit");
+  }
+}
+
+void testCase4(ThreadPool &pool, uint64_t workers) {
+  std::vector<uint64_t> t1(5000);
+  for (auto &v : t1)
+    v = (static_cast<uint64_t>(std::rand()) << 33) ^ std::rand();
+  std::vector<uint64_t> r1 = t1;
+  std::sort(r1.begin(), r1.end());
+  std::vector<uint64_t> t2 = t1;
+  engines::radixSort(t1.begin(), t1.end());
+  assert_msg(t1 == r1, "Wrong radix sort of 64-bit keys");
+  engines::parallelRadixSort(pool, workers, t2.begin(), t2.end());
+  assert_msg(t2 == r1, "Wrong parallel radix sort of 64-bit keys");
+
+  std::vector<GrainOfSand> t3 = {GrainOfSand(7), GrainOfSand(1),
+                                 GrainOfSand(4), GrainOfSand(1)};
+  std::vector<GrainOfSand> r3 = {GrainOfSand(1), GrainOfSand(1),
+                                 GrainOfSand(4), GrainOfSand(7)};
+  engines::parallelSortByKey(pool, workers, t3.begin(), t3.end(),
+                             std::less<GrainOfSand>());
+  assert_msg(t3 == r3, "Wrong radix sort of grains");
+
+  // Records have no sort key, so merge sort is used.
+  std::vector<Record> t4;
+  for (uint64_t i = 0; i < 100; ++i) t4.push_back({(i * 37) % 100, i});
+  engines::parallelSortByKey(pool, workers, t4.begin(), t4.end(), ByKey());
+  for (uint64_t i = 0; i < 100; ++i)
+    assert_eq_msg(t4[i].key, i, "Wrong fallback sort");
+}
+
+struct CountingKey {
+  explicit CountingKey(std::atomic<uint64_t> *callsArg) : calls(callsArg) {}
+
+  uint64_t operator()(Record const &record) const {
+    (*calls)++;
+    return record.key;
+  }
+
+  std::atomic<uint64_t> *calls;
+};
+
+void testCase5(ThreadPool &pool, uint64_t workers) {
+  std::vector<Record> t1;
+  for (uint64_t i = 0; i < 1000; ++i) t1.push_back({(i * 7919) % 1000, i});
+  std::vector<Record> t2 = t1;
+  std::atomic<uint64_t> calls(0);
+  engines::cachedKeySort(t1.begin(), t1.end(), CountingKey(&calls));
+  assert_eq_msg(calls, 1000, "Key should be computed once per element");
+  calls = 0;
+  engines::parallelCachedKeySort(pool, workers, t2.begin(), t2.end(),
+                                 CountingKey(&calls));
+  assert_eq_msg(calls, 1000, "Key should be computed once per element");
+  for (uint64_t i = 0; i < 1000; ++i) {
+    assert_eq_msg(t1[i].key, i, "Wrong cached key sort");
+    assert_eq_msg(t2[i].key, i, "Wrong parallel cached key sort");
+    assert_eq_msg(t2[i].payload, t1[i].payload, "Elements not permuted");
+  }
+
+  std::vector<Crystal> t3 = {Crystal(1), Crystal(9), Crystal(3), Crystal(9)};
+  assert_eq_msg(engines::parallelCachedKeyMaxElement(
+                    pool, workers, t3.begin(), t3.end(), CrystalKey()) -
+                    t3.begin(),
+                1, "Wrong cached key max position");
+}
+
+std::atomic<uint64_t> heapAllocations(0);
+
+// Not inlined, so compiler doesn't pair free with new expressions.
+__attribute__((noinline)) void *operator new(size_t size) {
+  heapAllocations++;
+  void *p = std::malloc(size == 0 ? 1 : size);
+  if (p == nullptr) throw std::bad_alloc();
+  return p;
+}
+
+__attribute__((noinline)) void operator delete(void *p) noexcept {
+  std::free(p);
+}
+
+void testArena() {
+  engines::Arena arena;
+  engines::Arena::Mark start = arena.mark();
+  char *a = static_cast<char *>(arena.allocate(10, 1));
+  uint64_t *b = static_cast<uint64_t *>(arena.allocate(8, 64));
+  assert_eq_msg(reinterpret_cast<uintptr_t>(b) % 64, 0, "Wrong alignment");
+  assert_msg(a != reinterpret_cast<char *>(b), "Overlapping allocations");
+  engines::Arena::Mark middle = arena.mark();
+  arena.allocate(100000, 8);
+  arena.rewind(middle);
+  assert_msg(arena.allocate(8, 64) == b + 8, "Rewind didn't free memory");
+  arena.rewind(start);
+  size_t capacity = arena.capacity();
+  arena.reset();
+  assert_eq_msg(arena.capacity(), capacity, "Reset should keep memory");
+  uint64_t before = heapAllocations;
+  arena.allocate(100000, 8);
+  uint64_t after = heapAllocations;
+  assert_eq_msg(after, before, "Merged block should be reused");
+  assert_msg(arena.highWater() >= 100000, "Wrong high water mark");
+  arena.trim(0);
+  assert_eq_msg(arena.capacity(), 0, "Trim should free memory");
+  assert_eq_msg(arena.highWater(), 0, "Trim should clear high water mark");
+}
+
+void testScratchReuse() {
+  std::vector<GrainOfSand> grains;
+  for (uint64_t i = 0; i < 20000; ++i) grains.push_back((i * 7919) % 20000);
+  std::vector<Egg> eggs;
+  for (uint64_t i = 1; i < 50; ++i) eggs.push_back(Egg(i, i * 3));
+  BottomlessBag bag(1000);
+  calibration::Tuning parallel;
+  parallel.taskNs = 1;
+  for (uint64_t shamans : {1, 3}) {
+    TeamAdventure adventure(shamans);
+    adventure.setTuning(parallel);
+    // First calls grow arenas, later ones should reuse them.
+    for (int i = 0; i < 3; ++i) {
+      std::vector<GrainOfSand> copy = grains;
+      uint64_t before = heapAllocations;
+      adventure.arrangeSand(copy);
+      adventure.packEggs(eggs, bag);
+      // Only handing tasks to shamans may allocate.
+      if (i == 2)
+        assert_msg(heapAllocations - before < 64 * shamans,
+                   "Steady state calls shouldn't allocate scratch memory");
+    }
+    assert_msg(adventure.getScratchHighWater()[0] > 0,
+               "Shared arena not used");
+    adventure.trimScratch(0);
+    assert_eq_msg(adventure.getScratchHighWater()[0], 0,
+                  "High water mark not cleared");
+  }
+}
+
+void testSparseKnapsack() {
+  uint64_t seed = 12345;
+  for (int round = 0; round < 50; ++round) {
+    std::vector<std::pair<uint64_t, uint64_t>> items;
+    for (int i = 0; i < round % 13; ++i) {
+      seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+      items.push_back({(seed >> 33) % 40 + 1, (seed >> 20) % 100});
+    }
+    uint64_t capacity = round * 3;
+    uint64_t dense = engines::knapsack(items.begin(), items.end(), capacity,
+                                       PairSize(), PairWeight());
+    assert_eq_msg(engines::paretoKnapsack(items.begin(), items.end(),
+                                          capacity, PairSize(), PairWeight()),
+                  dense, "Wrong pareto knapsack");
+    assert_eq_msg(
+        engines::meetInTheMiddleKnapsack(items.begin(), items.end(), capacity,
+                                         PairSize(), PairWeight()),
+        dense, "Wrong meet in the middle knapsack");
+    assert_eq_msg(engines::autoKnapsack(items.begin(), items.end(), capacity,
+                                        PairSize(), PairWeight()),
+                  dense, "Wrong auto knapsack");
+  }
+  std::vector<std::pair<uint64_t, uint64_t>> items(30, {1ull << 40, 1});
+  assert_msg(engines::chooseKnapsackEngine(items.begin(), items.end(),
+                                           1ull << 42, PairSize(),
+                                           PairWeight()) ==
+                 engines::KnapsackEngine::kMeetInTheMiddle,
+             "Few items with huge capacity should meet in the middle");
+  assert_msg(engines::chooseKnapsackEngine(items.begin(), items.end(),
+                                           1ull << 50, PairSize(),
+                                           PairWeight()) ==
+                 engines::KnapsackEngine::kAll,
+             "All items fit");
+  items.assign(2, {1ull << 63, 1});
+  assert_msg(engines::chooseKnapsackEngine(
+                 items.begin(), items.end(),
+                 std::numeric_limits<uint64_t>::max(), PairSize(),
+                 PairWeight()) != engines::KnapsackEngine::kAll,
+             "Sum of sizes above maximal capacity shouldn't fit");
+}
+
+void testSubsetSum(ThreadPool &pool, uint64_t workers) {
+  uint64_t seed = 777;
+  for (int round = 0; round < 20; ++round) {
+    std::vector<std::pair<uint64_t, uint64_t>> items;
+    for (int i = 0; i < round; ++i) {
+      seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+      uint64_t size = (seed >> 33) % 300;
+      items.push_back({size, 3 * size});
+    }
+    uint64_t capacity = round * 97;
+    uint64_t dense = engines::knapsack(items.begin(), items.end(), capacity,
+                                       PairSize(), PairWeight());
+    assert_msg(engines::proportionalWeights(items.begin(), items.end(),
+                                            PairSize(), PairWeight()),
+               "Weights should be proportional");
+    assert_eq_msg(
+        engines::subsetSumKnapsack(items.begin(), items.end(), capacity,
+                                   PairSize(), PairWeight()),
+        dense, "Wrong subset sum knapsack");
+    assert_eq_msg(engines::parallelSubsetSumKnapsack(
+                      pool, workers, items.begin(), items.end(), capacity,
+                      PairSize(), PairWeight()),
+                  dense, "Wrong parallel subset sum knapsack");
+  }
+  std::vector<std::pair<uint64_t, uint64_t>> items = {{2, 4}, {3, 7}};
+  assert_msg(!engines::proportionalWeights(items.begin(), items.end(),
+                                           PairSize(), PairWeight()),
+             "Weights aren't proportional");
+}
+
+void testPrepareItems() {
+  typedef engines::KnapsackItem Item;
+  std::vector<std::pair<uint64_t, uint64_t>> items = {
+      {3, 5}, {50, 9}, {0, 4}, {2, 0}, {3, 5}, {3, 5}, {3, 5}, {3, 5}, {1, 1}};
+  engines::ScratchVector<Item> prepared;
+  uint64_t packed = engines::prepareItems(items.begin(), items.end(), 10,
+                                          PairSize(), PairWeight(), prepared);
+  assert_eq_msg(packed, 4, "Item without size should be packed");
+  // Three of five copies fit, they are bundled as 1 and 2 copies.
+  std::vector<Item> expected = {{1, 1}, {3, 5}, {6, 10}};
+  assert_eq_msg(prepared.size(), expected.size(), "Wrong number of items");
+  for (size_t i = 0; i < expected.size(); ++i)
+    assert_msg(prepared[i] == expected[i], "Wrong prepared item");
+  packed = engines::prepareItems(items.begin(), items.end(), 1000, PairSize(),
+                                 PairWeight(), prepared);
+  assert_eq_msg(packed, 4 + 5 * 5 + 9 + 1, "All items should fit");
+  assert_eq_msg(prepared.size(), 0, "No item should be left");
+  items = {{(1ull << 63) + 5, 3}, {(1ull << 63) + 6, 4}};
+  packed = engines::prepareItems(items.begin(), items.end(),
+                                 (1ull << 63) + 10, PairSize(), PairWeight(),
+                                 prepared);
+  assert_eq_msg(packed, 0, "Items with overflowing sum shouldn't fit");
+  assert_eq_msg(prepared.size(), 2, "Both items should be left");
+
+  uint64_t seed = 99;
+  for (int round = 0; round < 30; ++round) {
+    std::vector<std::pair<uint64_t, uint64_t>> random;
+    for (int i = 0; i < 3 * round; ++i) {
+      seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+      random.push_back({(seed >> 33) % 6, (seed >> 40) % 4});
+    }
+    uint64_t capacity = round * 2;
+    assert_eq_msg(
+        engines::packKnapsack(random.begin(), random.end(), capacity,
+                              PairSize(), PairWeight()),
+        engines::knapsack(random.begin(), random.end(), capacity, PairSize(),
+                          PairWeight()),
+        "Prepared items should have the same solution");
+  }
+}
+
+void testApproximateKnapsack() {
+  uint64_t seed = 5;
+  for (double epsilon : {0.0, 0.01, 0.1, 0.5}) {
+    for (int round = 1; round < 20; ++round) {
+      std::vector<std::pair<uint64_t, uint64_t>> items;
+      for (int i = 0; i < 3 * round; ++i) {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        items.push_back({(seed >> 33) % 20000 + 1, (seed >> 40) % 1000});
+      }
+      uint64_t capacity = 50000;
+      uint64_t optimum = engines::knapsack(items.begin(), items.end(),
+                                           capacity, PairSize(), PairWeight());
+      engines::ApproximateWeight result = engines::approximateKnapsack(
+          items.begin(), items.end(), capacity, PairSize(), PairWeight(),
+          epsilon);
+      assert_msg(result.weight <= optimum && optimum <= result.bound,
+                 "Optimum should be between result and bound");
+      assert_msg(result.weight >= (1 - epsilon) * optimum,
+                 "Result should be within relative error");
+      engines::ApproximateWeight packed = engines::packApproximately(
+          items.begin(), items.end(), capacity, PairSize(), PairWeight(),
+          epsilon);
+      assert_msg(packed.weight <= optimum && optimum <= packed.bound &&
+                     packed.weight >= (1 - epsilon) * optimum,
+                 "Prepared result should be within relative error");
+    }
+  }
+  std::vector<std::pair<uint64_t, uint64_t>> items;
+  for (uint64_t i = 0; i < 40; ++i) items.push_back({i * 1000 + 7, i * 50 + 1});
+  assert_msg(engines::approximationPays(items.begin(), items.end(), 300000,
+                                        PairSize(), PairWeight(), 0.5),
+             "Trimmed front should be smaller than exact one");
+  assert_msg(!engines::approximationPays(items.begin(), items.end(), 300000,
+                                         PairSize(), PairWeight(), 0),
+             "Exact solution needs no trimming");
+}
+
+void testCalibration() {
+  calibration::Tuning tuning;
+  tuning.taskNs = 10000;
+  tuning.selectNs = tuning.sortNs = tuning.knapsackNs = 1;
+  assert_eq_msg(calibration::selectWorkers(tuning, 7, 8), 1,
+                "Small selection should be sequential");
+  assert_eq_msg(calibration::sortWorkers(tuning, tuning.sortNs, 7, 8), 1,
+                "Small sort should be sequential");
+  assert_eq_msg(calibration::knapsackWorkers(tuning, 3, 9, 8), 1,
+                "Small knapsack should be sequential");
+  assert_eq_msg(calibration::selectWorkers(tuning, 100000000, 8), 8,
+                "Large selection should use all workers");
+  assert_eq_msg(calibration::knapsackWorkers(tuning, 1000, 10000000, 8), 8,
+                "Large knapsack should use all workers");
+  uint64_t groups = calibration::itemSplitWorkers(tuning, 1000000, 50, 8);
+  assert_eq_msg(groups, 8, "Tall knapsack should split items");
+  assert_msg(calibration::itemSplitNs(tuning, 1000000, 50, groups) <
+                 calibration::columnSplitNs(
+                     tuning, 1000000, 50,
+                     calibration::knapsackWorkers(tuning, 1000000, 50, 8)),
+             "Tall knapsack should prefer splitting items");
+  groups = calibration::itemSplitWorkers(tuning, 1000, 10000000, 8);
+  assert_msg(calibration::itemSplitNs(tuning, 1000, 10000000, groups) >
+                 calibration::columnSplitNs(tuning, 1000, 10000000, 8),
+             "Wide knapsack should prefer splitting columns");
+
+  std::string path = "/tmp/enginesTestXXXXXX";
+  int fd = mkstemp(&path[0]);
+  assert_msg(fd >= 0, "Can't create temporary file");
+  close(fd);
+  tuning.taskNs = 1234;
+  tuning.introSortNs = 77;
+  assert_msg(tuning.save(path), "Tuning not saved");
+  calibration::Tuning loaded;
+  assert_msg(loaded.load(path), "Tuning not loaded");
+  assert_eq_msg(loaded.taskNs, 1234, "Wrong loaded tuning");
+  assert_eq_msg(loaded.introSortNs, 77, "Wrong loaded sort cost");
+  std::remove(path.c_str());
+  assert_msg(!loaded.load(path), "Missing tuning file loaded");
+
+  calibration::Tuning measured = calibration::measure();
+  assert_msg(measured.taskNs > 0 && measured.selectNs > 0 &&
+                 measured.sortNs > 0 && measured.radixSortNs > 0 &&
+                 measured.cachedKeySortNs > 0 && measured.runSortNs > 0 &&
+                 measured.introSortNs > 0 && measured.knapsackNs > 0,
+             "Measured costs should be positive");
+  assert_msg(measured.radixSortNs < measured.introSortNs,
+             "Sort by keys should be cheaper than comparisons of grains");
+}
+
+void testThreadPoolMetrics() {
+  std::ostringstream dump;
+  {
+    ThreadPool pool(3);
+    bool rejected = false;
+    try {
+      pool.setMetricsDump(&dump, std::chrono::milliseconds(0));
+    } catch (std::invalid_argument const&) {
+      rejected = true;
+    }
+    assert_msg(rejected, "Zero period of metrics dump should be rejected");
+    assert_eq_msg(pool.metrics().size(), 3, "Metrics should cover workers");
+    pool.setMetricsDump(&dump, std::chrono::milliseconds(1));
+    const uint64_t kTasks = 30;
+    for (uint64_t i = 0; i < kTasks; i++)
+      pool.enqueue([]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+          })
+          .get();
+#ifdef THREADPOOL_METRICS
+    // Task is counted after its future is ready.
+    uint64_t tasks = 0;
+    for (int attempt = 0; attempt < 1000 && tasks < kTasks; attempt++) {
+      ThreadPool::Metrics total;
+      for (ThreadPool::Metrics const& worker : pool.metrics())
+        total.add(worker);
+      tasks = total.tasks;
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    assert_eq_msg(tasks, kTasks, "Every task should be counted");
+#endif
+  }
+  // Workers are joined, so dump is no longer written.
+#ifdef THREADPOOL_METRICS
+  assert_msg(dump.str().find("pool: tasks") != std::string::npos,
+             "Metrics should be dumped");
+#else
+  assert_msg(dump.str().empty(), "Metrics aren't collected");
+#endif
+}
+
+/** @brief JsonChecker - checks syntax of JSON text.
+ */
+class JsonChecker {
+ public:
+  explicit JsonChecker(std::string const &textArg) : text(textArg), pos(0) {}
+
+  bool valid() {
+    bool ok = value();
+    space();
+    return ok && pos == text.size();
+  }
+
+ private:
+  void space() {
+    while (pos < text.size() && std::isspace(text[pos])) pos++;
+  }
+
+  bool accept(char c) {
+    space();
+    if (pos < text.size() && text[pos] == c) {
+      pos++;
+      return true;
+    }
+    return false;
+  }
+
+  bool value() {
+    space();
+    if (pos == text.size()) return false;
+    char c = text[pos];
+    if (c == '{') return sequence('{', '}', true);
+    if (c == '[') return sequence('[', ']', false);
+    if (c == '"') return string();
+    if (text.compare(pos, 4, "true") == 0 ||
+        text.compare(pos, 4, "null") == 0) {
+      pos += 4;
+      return true;
+    }
+    if (text.compare(pos, 5, "false") == 0) {
+      pos += 5;
+      return true;
+    }
+    return number();
+  }
+
+  bool sequence(char open, char close, bool members) {
+    accept(open);
+    if (accept(close)) return true;
+    do {
+      if (members && !(string() && accept(':'))) return false;
+      if (!value()) return false;
+    } while (accept(','));
+    return accept(close);
+  }
+
+  bool string() {
+    if (!accept('"')) return false;
+    while (pos < text.size() && text[pos] != '"') {
+      if (text[pos] == '\\') pos++;
+      pos++;
+    }
+    return accept('"');
+  }
+
+  bool number() {
+    size_t start = pos;
+    if (pos < text.size() && text[pos] == '-') pos++;
+    while (pos < text.size() &&
+           (std::isdigit(text[pos]) || text[pos] == '.' || text[pos] == 'e' ||
+            text[pos] == 'E' || text[pos] == '+' || text[pos] == '-'))
+      pos++;
+    return pos > start && std::isdigit(text[pos - 1]);
+  }
+
+  std::string const &text;
+  size_t pos;
+};
+
+/** @brief numberAfter - reads number following key in event's line.
+ * @return Number or -1 if key is missing.
+ */
+double numberAfter(std::string const &line, std::string const &key) {
+  size_t at = line.find("\"" + key + "\":");
+  if (at == std::string::npos) return -1;
+  return std::atof(line.c_str() + at + key.size() + 3);
+}
+
+void testTrace(ThreadPool &pool, uint64_t workers) {
+  tracing::Registry::instance().clear();
+  {
+    tracing::Scope outer("outer", 1);
+    std::vector<std::future<void>> done;
+    for (uint64_t i = 0; i < workers; i++) {
+      done.push_back(pool.enqueue([i]() {
+        tracing::Scope task("task", i);
+        tracing::Scope inner("inner", i);
+        tracing::instant("moment", i);
+      }));
+    }
+    for (auto &future : done) future.get();
+  }
+  std::ostringstream out;
+  tracing::Registry::instance().write(out);
+  std::string trace = out.str();
+  assert_msg(!JsonChecker("{\"a\":[1,]}").valid(), "Broken JSON accepted");
+  assert_msg(JsonChecker(trace).valid(), "Trace isn't valid JSON");
+  // Each event is on its own line, complete events of a thread must nest.
+  std::istringstream lines(trace);
+  std::string line;
+  std::map<int, std::vector<std::pair<double, double>>> open;
+  uint64_t complete = 0, instants = 0;
+  while (std::getline(lines, line)) {
+    if (line.find("\"ph\":\"i\"") != std::string::npos) instants++;
+    if (line.find("\"ph\":\"X\"") == std::string::npos) continue;
+    complete++;
+    int tid = static_cast<int>(numberAfter(line, "tid"));
+    double begin = numberAfter(line, "ts"), duration = numberAfter(line, "dur");
+    assert_msg(begin >= 0 && duration >= 0, "Complete event without interval");
+    // Events are recorded when they end, so children come before parents.
+    std::vector<std::pair<double, double>> &children = open[tid];
+    while (!children.empty() && children.back().first >= begin) {
+      assert_msg(children.back().second <= begin + duration + 1e-3,
+                 "Trace events of a thread should nest");
+      children.pop_back();
+    }
+    children.push_back({begin, begin + duration});
+  }
+  assert_eq_msg(complete, 2 * workers + 1, "Wrong number of complete events");
+  assert_eq_msg(instants, workers, "Wrong number of instant events");
+  tracing::Registry::instance().clear();
+}
+
+int main() {
+  testThreadPoolMetrics();
+  testArena();
+  testScratchReuse();
+  testSparseKnapsack();
+  testPrepareItems();
+  testApproximateKnapsack();
+  testCalibration();
+  for (uint64_t workers : {1, 2, 3, 8}) {
+    ThreadPool pool(workers);
+    testCase1(pool, workers);
+    testCase2(pool, workers);
+    testCase3(pool, workers);
+    testCellWidths(pool, workers);
+    testItemParallel(pool, workers);
+    testRunSort(pool, workers);
+    testSortingNetwork(pool, workers);
+    testTopElements(pool, workers);
+    testIntroSort(pool, workers);
+    testCase4(pool, workers);
+    testCase5(pool, workers);
+    testSubsetSum(pool, workers);
+    testTrace(pool, workers);
+  }
+  return 0;
+}
@@ -1,5 +1,11 @@
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <algorithm>
 #include <chrono>
+#include <cstdio>
 #include <iomanip>
+#include <string>
 #include <vector>
 
 #include "../adventure.h"
@@ -31,6 +37,121 @@ void testCase1(Adventure &adventure) {
   runAndVerify(adventure, t3, r3);
 }
 
+std::string temporaryPath() {
+  std::string path = "/tmp/sandArrangementXXXXXX";
+  int fd = mkstemp(&path[0]);
+  assert_msg(fd >= 0, "Can't create temporary file");
+  close(fd);
+  return path;
+}
+
+void testCase2(Adventure &adventure) {
+  std::string input = temporaryPath(), output = temporaryPath();
+  for (size_t n : {0, 1, 1000, 20000}) {
+    std::vector<uint64_t> sizes(n);
+    for (auto &size : sizes) size = std::rand() % 5000;
+    {
+      engines::File file = engines::openFile(input, "wb");
+      engines::writeBlock(file.get(), sizes.data(), n);
+    }
+    std::sort(sizes.begin(), sizes.end());
+    // Small memory merges runs in several passes.
+    for (size_t memory : {size_t(1) << 12, size_t(1) << 20}) {
+      uint64_t arranged = adventure.arrangeSandFile(input, output, memory,
+                                                    "/tmp");
+      assert_eq_msg(arranged, n, "Wrong number of arranged grains");
+      std::vector<uint64_t> result(n + 1);
+      engines::File file = engines::openFile(output, "rb");
+      assert_eq_msg(engines::readBlock(file.get(), result.data(), n + 1), n,
+                    "Wrong size of arranged file");
+      result.pop_back();
+      assert_msg(result == sizes, "Wrong file sand arrangement");
+    }
+  }
+  std::remove(input.c_str());
+  std::remove(output.c_str());
+}
+
+void testFileLimit(Adventure &adventure) {
+  std::string input = temporaryPath(), output = temporaryPath();
+  std::vector<uint64_t> sizes(20000);
+  for (auto &size : sizes) size = std::rand() % 5000;
+  {
+    engines::File file = engines::openFile(input, "wb");
+    engines::writeBlock(file.get(), sizes.data(), sizes.size());
+  }
+  std::sort(sizes.begin(), sizes.end());
+  // Small memory makes more runs than files the process may open.
+  struct rlimit limit;
+  assert_msg(getrlimit(RLIMIT_NOFILE, &limit) == 0, "Can't get file limit");
+  struct rlimit lowered = limit;
+  lowered.rlim_cur = 48;
+  assert_msg(setrlimit(RLIMIT_NOFILE, &lowered) == 0, "Can't set file limit");
+  uint64_t arranged =
+      adventure.arrangeSandFile(input, output, size_t(1) << 12, "/tmp");
+  setrlimit(RLIMIT_NOFILE, &limit);
+  assert_eq_msg(arranged, sizes.size(), "Wrong number of arranged grains");
+  std::vector<uint64_t> result(sizes.size());
+  engines::File file = engines::openFile(output, "rb");
+  engines::readBlock(file.get(), result.data(), result.size());
+  assert_msg(result == sizes, "Wrong file sand arrangement");
+  std::remove(input.c_str());
+  std::remove(output.c_str());
+}
+
+void testCase3(Adventure &adventure) {
+  std::string path = temporaryPath();
+  std::vector<GrainOfSand> sorted;
+  {
+    engines::MappedColumns file = engines::MappedColumns::create(
+        path, engines::ColumnarKind::kGrains, 3000);
+    engines::Span<GrainOfSand> grains =
+        engines::mutableColumnView<GrainOfSand>(file, 0);
+    for (GrainOfSand &grain : grains) grain = GrainOfSand(std::rand() % 100);
+    sorted.assign(grains.begin(), grains.end());
+    std::sort(sorted.begin(), sorted.end());
+    TeamAdventure *team = dynamic_cast<TeamAdventure *>(&adventure);
+    if (team != nullptr) team->touchColumns(file);
+    adventure.arrangeSand(grains);
+  }
+  // Arrangement reached the file.
+  engines::MappedColumns file(path, false);
+  engines::Span<GrainOfSand const> grains =
+      engines::columnView<GrainOfSand>(file, 0);
+  assert_msg(std::vector<GrainOfSand>(grains.begin(), grains.end()) == sorted,
+             "Wrong mapped sand arrangement");
+  std::remove(path.c_str());
+}
+
+void testStrategy(Adventure &adventure, SandStrategy strategy) {
+  adventure.setSandStrategy(strategy);
+  TeamAdventure *team = dynamic_cast<TeamAdventure *>(&adventure);
+  calibration::Tuning tuning;
+  if (team != nullptr) {
+    tuning = team->getTuning();
+    // Free tasks make the team split sorts among shamans.
+    calibration::Tuning parallel = tuning;
+    parallel.taskNs = 0;
+    team->setTuning(parallel);
+  }
+  testCase1(adventure);
+  // Random, few distinct, sorted and reversed grains.
+  for (uint64_t range : {1ull << 40, 3ull}) {
+    std::vector<GrainOfSand> t1(5000);
+    for (auto &grain : t1)
+      grain = GrainOfSand(
+          ((static_cast<uint64_t>(std::rand()) << 31) ^ std::rand()) % range);
+    std::vector<GrainOfSand> r1 = t1;
+    std::sort(r1.begin(), r1.end());
+    std::vector<GrainOfSand> t2 = r1, t3(r1.rbegin(), r1.rend());
+    runAndVerify(adventure, t1, r1);
+    runAndVerify(adventure, t2, r1);
+    runAndVerify(adventure, t3, r1);
+  }
+  adventure.setSandStrategy(SandStrategy::kMergeSort);
+  if (team != nullptr) team->setTuning(tuning);
+}
+
 int main(int argc, char **argv) {
   for (std::shared_ptr<Adventure> adventure :
        std::vector<std::shared_ptr<Adventure> >{
@@ -43,6 +164,13 @@ int main(int argc, char **argv) {
     if (argc == 1) {
       // runAndPrintDuration([&adventure]() {
       testCase1(*adventure);
+      testCase2(*adventure);
+      testFileLimit(*adventure);
+      testCase3(*adventure);
+      testStrategy(*adventure, SandStrategy::kRadixSort);
+      testStrategy(*adventure, SandStrategy::kCachedKeys);
+      testStrategy(*adventure, SandStrategy::kRunSort);
+      testStrategy(*adventure, SandStrategy::kIntroSort);
       // });
     } else {
       std::vector<GrainOfSand> t2(50000);
@@ -0,0 +1,206 @@
+#ifndef SRC_TRACE_H_
+#define SRC_TRACE_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/** Timeline tracing of adventures' stages exported as Chrome trace JSON
+ * (loadable by chrome://tracing and Perfetto). Events are recorded only when
+ * compiled with ADVENTURE_TRACE, otherwise TRACE_* macros expand to nothing.
+ */
+namespace tracing {
+
+/** @brief Event - single trace event.
+ * Complete events ('X') describe interval, instant events ('i') a moment.
+ */
+struct Event {
+  const char* name;
+  char phase;
+  uint64_t start;
+  uint64_t duration;
+  uint64_t arg;
+};
+
+/** @brief RingBuffer - events of one thread.
+ * Only owner thread writes to buffer, so recording is lock-free. When buffer
+ * is full the oldest events are overwritten.
+ */
+class RingBuffer {
+ public:
+  static const uint64_t kCapacity = 1 << 16;
+
+  explicit RingBuffer(uint64_t tidArg)
+      : tid(tidArg), head(0), events(kCapacity) {}
+
+  /** @brief push - records event, used only by owner thread.
+   * @param event[in]   - event to record.
+   */
+  void push(Event const& event) {
+    uint64_t position = head.load(std::memory_order_relaxed);
+    events[position % kCapacity] = event;
+    head.store(position + 1, std::memory_order_release);
+  }
+
+  /** @brief snapshot - copies recorded events, from the oldest one.
+   * @return Recorded events.
+   */
+  std::vector<Event> snapshot() const {
+    uint64_t last = head.load(std::memory_order_acquire);
+    uint64_t first = last > kCapacity ? last - kCapacity : 0;
+    std::vector<Event> result;
+    for (uint64_t i = first; i < last; i++)
+      result.push_back(events[i % kCapacity]);
+    return result;
+  }
+
+  /** @brief clear - drops recorded events. */
+  void clear() { head.store(0, std::memory_order_release); }
+
+  uint64_t getTid() const { return tid; }
+
+ private:
+  uint64_t tid;
+  std::atomic<uint64_t> head;
+  std::vector<Event> events;
+};
+
+/** @brief Registry - owns buffers of all threads which recorded events.
+ * Buffers outlive their threads, so events of finished shamans are kept.
+ */
+class Registry {
+ public:
+  static Registry& instance() {
+    static Registry registry;
+    return registry;
+  }
+
+  /** @brief now - time since registry creation.
+   * @return Time in nanoseconds.
+   */
+  uint64_t now() const {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now() - origin)
+        .count();
+  }
+
+  /** @brief local - provides buffer of calling thread.
+   * @return Reference to thread's buffer.
+   */
+  RingBuffer& local() {
+    static thread_local RingBuffer* buffer = nullptr;
+    if (buffer == nullptr) {
+      std::lock_guard<std::mutex> lock(mutex);
+      buffers.emplace_back(new RingBuffer(buffers.size()));
+      buffer = buffers.back().get();
+    }
+    return *buffer;
+  }
+
+  /** @brief write - writes recorded events as Chrome trace JSON.
+   * Should be called when no adventure is running.
+   * @param out[in, out]   - output stream.
+   */
+  void write(std::ostream& out) {
+    std::lock_guard<std::mutex> lock(mutex);
+    bool first = true;
+    out << "{\"traceEvents\":[";
+    for (auto const& buffer : buffers) {
+      uint64_t tid = buffer->getTid();
+      out << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\","
+          << "\"pid\":1,\"tid\":" << tid << ",\"args\":{\"name\":\""
+          << "thread " << tid << "\"}}";
+      first = false;
+      for (Event const& event : buffer->snapshot()) {
+        out << ",\n{\"name\":\"" << event.name << "\",\"ph\":\""
+            << event.phase << "\",\"pid\":1,\"tid\":" << tid
+            << ",\"ts\":" << microseconds(event.start);
+        if (event.phase == 'X')
+          out << ",\"dur\":" << microseconds(event.duration);
+        else
+          out << ",\"s\":\"t\"";
+        out << ",\"args\":{\"value\":" << event.arg << "}}";
+      }
+    }
+    out << "\n]}\n";
+  }
+
+  /** @brief clear - drops events recorded by all threads. */
+  void clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto& buffer : buffers) buffer->clear();
+  }
+
+ private:
+  Registry() : origin(std::chrono::steady_clock::now()) {}
+
+  static std::string microseconds(uint64_t ns) {
+    std::string fraction = std::to_string(ns % 1000);
+    return std::to_string(ns / 1000) + "." +
+           std::string(3 - fraction.size(), '0') + fraction;
+  }
+
+  std::chrono::steady_clock::time_point origin;
+  std::mutex mutex;
+  std::vector<std::unique_ptr<RingBuffer>> buffers;
+};
+
+/** @brief Scope - records complete event lasting as long as the object.
+ */
+class Scope {
+ public:
+  Scope(const char* nameArg, uint64_t argArg)
+      : name(nameArg), arg(argArg), start(Registry::instance().now()) {}
+
+  ~Scope() {
+    Registry& registry = Registry::instance();
+    registry.local().push({name, 'X', start, registry.now() - start, arg});
+  }
+
+ private:
+  const char* name;
+  uint64_t arg;
+  uint64_t start;
+};
+
+/** @brief instant - records instant event.
+ * @param name[in]   - name of event, must outlive the registry;
+ * @param arg        - value attached to event.
+ */
+inline void instant(const char* name, uint64_t arg) {
+  Registry& registry = Registry::instance();
+  registry.local().push({name, 'i', registry.now(), 0, arg});
+}
+
+/** @brief writeChromeTrace - saves recorded events to file.
+ * @param path[in]   - path of output file.
+ * @return True if file was written.
+ */
+inline bool writeChromeTrace(std::string const& path) {
+  std::ofstream out(path);
+  if (!out) return false;
+  Registry::instance().write(out);
+  return static_cast<bool>(out);
+}
+
+}  // namespace tracing
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+#ifdef ADVENTURE_TRACE
+#define TRACE_SCOPE(name, arg) \
+  tracing::Scope TRACE_CONCAT(traceScope, __LINE__)(name, arg)
+#define TRACE_INSTANT(name, arg) tracing::instant(name, arg)
+#else
+#define TRACE_SCOPE(name, arg)
+#define TRACE_INSTANT(name, arg)
+#endif
+
+#endif  // SRC_TRACE_H_
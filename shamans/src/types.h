@@ -34,6 +34,8 @@ class GrainOfSand {
 
   GrainOfSand(uint64_t sizeArg) : size(sizeArg) {}  //  NOLINT
 
+  uint64_t getSize() const { return this->size; }
+
   bool operator<(GrainOfSand const& other) const {
     burden(this->size, other.size);
     return this->size < other.size;
@@ -58,6 +60,8 @@ class Crystal {
 
   Crystal(uint64_t shininessArg) : shininess(shininessArg) {}  // NOLINT
 
+  uint64_t getShininess() const { return this->shininess; }
+
   bool operator<(Crystal const& other) const {
     burden(this->shininess, other.shininess);
     return this->shininess < other.shininess;
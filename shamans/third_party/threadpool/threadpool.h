@@ -1,57 +1,320 @@
 #ifndef THREAD_POOL_H
 #define THREAD_POOL_H
 
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <cstdint>
 #include <functional>
 #include <future>
 #include <memory>
 #include <mutex>
+#include <ostream>
 #include <queue>
+#include <sstream>
 #include <stdexcept>
+#include <string>
 #include <thread>
 #include <vector>
 
 class ThreadPool {
  public:
+  // histogram bucket i counts durations in [2^(i-1), 2^i) ns
+  static const size_t kMetricsBuckets = 32;
+
+  // snapshot of one worker's runtime counters, collected only when compiled
+  // with THREADPOOL_METRICS
+  struct Metrics {
+    Metrics();
+    void add(Metrics const& other);
+    void print(std::ostream& out, std::string const& name) const;
+
+    uint64_t tasks;
+    uint64_t waitNs;
+    uint64_t runNs;
+    uint64_t idleNs;
+    uint64_t wakeups;
+    uint64_t waitHist[kMetricsBuckets];
+    uint64_t runHist[kMetricsBuckets];
+  };
+
   ThreadPool(size_t);
   template <class F, class... Args>
   auto enqueue(F&& f, Args&&... args)
       -> std::future<typename std::result_of<F(Args...)>::type>;
+  // per worker snapshot of runtime counters
+  std::vector<Metrics> metrics();
+  // writes counters to out every period, nullptr disables the dump; throws
+  // std::invalid_argument for non-positive period of enabled dump
+  void setMetricsDump(std::ostream* out, std::chrono::milliseconds period);
+  // index of the calling thread among this pool's workers, -1 for threads
+  // which are not its workers
+  int workerIndex() const;
   ~ThreadPool();
 
  private:
+  typedef std::chrono::steady_clock Clock;
+
+  struct Task {
+    std::function<void()> function;
+    // set only when metrics are collected
+    Clock::time_point enqueued;
+  };
+
+  // counters updated by their owner only, kept on the owner's stack and
+  // cache line aligned so workers never share a line
+  struct alignas(64) Counters {
+    Counters();
+    void recordTask(Clock::duration wait, Clock::duration run);
+    void recordIdle(Clock::duration idle);
+    Metrics snapshot() const;
+
+    std::atomic<uint64_t> tasks;
+    std::atomic<uint64_t> waitNs;
+    std::atomic<uint64_t> runNs;
+    std::atomic<uint64_t> idleNs;
+    std::atomic<uint64_t> wakeups;
+    std::atomic<uint64_t> waitHist[kMetricsBuckets];
+    std::atomic<uint64_t> runHist[kMetricsBuckets];
+  };
+
+  struct WorkerIdentity {
+    const ThreadPool* pool;
+    int index;
+  };
+  static WorkerIdentity& currentWorker();
+
+  void waitForWork(std::unique_lock<std::mutex>& lock, Counters& counters);
+  void dumpDueMetrics(std::unique_lock<std::mutex>& lock);
+  std::vector<Metrics> metricsLocked();
+
   // need to keep track of threads so we can join them
   std::vector<std::thread> workers;
   // the task queue
-  std::queue<std::function<void()> > tasks;
+  std::queue<Task> tasks;
 
   // synchronization
   std::mutex queue_mutex;
   std::condition_variable condition;
   bool stop;
+
+  // metrics of running workers and of those which already finished
+  std::vector<Counters*> counters;
+  std::vector<Metrics> finished;
+  std::ostream* dumpStream;
+  Clock::duration dumpPeriod;
+  Clock::time_point nextDump;
 };
 
+inline ThreadPool::Metrics::Metrics()
+    : tasks(0), waitNs(0), runNs(0), idleNs(0), wakeups(0) {
+  for (size_t i = 0; i < kMetricsBuckets; ++i) waitHist[i] = runHist[i] = 0;
+}
+
+inline void ThreadPool::Metrics::add(Metrics const& other) {
+  tasks += other.tasks;
+  waitNs += other.waitNs;
+  runNs += other.runNs;
+  idleNs += other.idleNs;
+  wakeups += other.wakeups;
+  for (size_t i = 0; i < kMetricsBuckets; ++i) {
+    waitHist[i] += other.waitHist[i];
+    runHist[i] += other.runHist[i];
+  }
+}
+
+inline void ThreadPool::Metrics::print(std::ostream& out,
+                                       std::string const& name) const {
+  out << name << ": tasks " << tasks << ", wait " << waitNs << " ns, run "
+      << runNs << " ns, idle " << idleNs << " ns, wakeups " << wakeups
+      << std::endl;
+  out << "  wait ns:";
+  for (size_t i = 0; i < kMetricsBuckets; ++i)
+    if (waitHist[i] > 0) out << " <2^" << i << ":" << waitHist[i];
+  out << std::endl << "  run ns:";
+  for (size_t i = 0; i < kMetricsBuckets; ++i)
+    if (runHist[i] > 0) out << " <2^" << i << ":" << runHist[i];
+  out << std::endl;
+}
+
+inline ThreadPool::Counters::Counters()
+    : tasks(0), waitNs(0), runNs(0), idleNs(0), wakeups(0) {
+  for (size_t i = 0; i < kMetricsBuckets; ++i) {
+    waitHist[i].store(0, std::memory_order_relaxed);
+    runHist[i].store(0, std::memory_order_relaxed);
+  }
+}
+
+namespace threadpool_detail {
+// owner-only increment, plain store keeps readers from seeing torn values
+inline void increase(std::atomic<uint64_t>& counter, uint64_t value) {
+  counter.store(counter.load(std::memory_order_relaxed) + value,
+                std::memory_order_relaxed);
+}
+
+inline size_t bucket(uint64_t ns) {
+  size_t b = ns == 0 ? 0 : 64 - __builtin_clzll(ns);
+  return b < ThreadPool::kMetricsBuckets ? b
+                                         : ThreadPool::kMetricsBuckets - 1;
+}
+
+inline uint64_t nanoseconds(std::chrono::steady_clock::duration d) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+}
+}  // namespace threadpool_detail
+
+inline void ThreadPool::Counters::recordTask(Clock::duration wait,
+                                             Clock::duration run) {
+  using threadpool_detail::increase;
+  uint64_t waitValue = threadpool_detail::nanoseconds(wait);
+  uint64_t runValue = threadpool_detail::nanoseconds(run);
+  increase(tasks, 1);
+  increase(waitNs, waitValue);
+  increase(runNs, runValue);
+  increase(waitHist[threadpool_detail::bucket(waitValue)], 1);
+  increase(runHist[threadpool_detail::bucket(runValue)], 1);
+}
+
+inline void ThreadPool::Counters::recordIdle(Clock::duration idle) {
+  threadpool_detail::increase(idleNs, threadpool_detail::nanoseconds(idle));
+  threadpool_detail::increase(wakeups, 1);
+}
+
+inline ThreadPool::Metrics ThreadPool::Counters::snapshot() const {
+  Metrics result;
+  result.tasks = tasks.load(std::memory_order_relaxed);
+  result.waitNs = waitNs.load(std::memory_order_relaxed);
+  result.runNs = runNs.load(std::memory_order_relaxed);
+  result.idleNs = idleNs.load(std::memory_order_relaxed);
+  result.wakeups = wakeups.load(std::memory_order_relaxed);
+  for (size_t i = 0; i < kMetricsBuckets; ++i) {
+    result.waitHist[i] = waitHist[i].load(std::memory_order_relaxed);
+    result.runHist[i] = runHist[i].load(std::memory_order_relaxed);
+  }
+  return result;
+}
+
 // the constructor just launches some amount of workers
-inline ThreadPool::ThreadPool(size_t threads) : stop(false) {
+inline ThreadPool::ThreadPool(size_t threads)
+    : stop(false),
+      counters(threads, nullptr),
+      finished(threads),
+      dumpStream(nullptr) {
   for (size_t i = 0; i < threads; ++i)
-    workers.emplace_back([this] {
+    workers.emplace_back([this, i] {
+      currentWorker() = {this, static_cast<int>(i)};
+      Counters own;
+      {
+        std::unique_lock<std::mutex> lock(this->queue_mutex);
+        this->counters[i] = &own;
+      }
       for (;;) {
-        std::function<void()> task;
+        Task task;
 
         {
           std::unique_lock<std::mutex> lock(this->queue_mutex);
+#ifdef THREADPOOL_METRICS
+          this->waitForWork(lock, own);
+#else
           this->condition.wait(
               lock, [this] { return this->stop || !this->tasks.empty(); });
-          if (this->stop && this->tasks.empty()) return;
+#endif
+          if (this->stop && this->tasks.empty()) {
+            // keep counters of finished worker
+            this->finished[i] = own.snapshot();
+            this->counters[i] = nullptr;
+            return;
+          }
           task = std::move(this->tasks.front());
           this->tasks.pop();
         }
 
-        task();
+#ifdef THREADPOOL_METRICS
+        Clock::time_point start = Clock::now();
+        task.function();
+        own.recordTask(start - task.enqueued, Clock::now() - start);
+#else
+        task.function();
+#endif
       }
     });
 }
 
+// waits for work, counting idle time and wake ups and dumping metrics when
+// it's time to do it; lock must own queue_mutex
+inline void ThreadPool::waitForWork(std::unique_lock<std::mutex>& lock,
+                                    Counters& own) {
+  dumpDueMetrics(lock);
+  Clock::time_point start = Clock::now();
+  while (!stop && tasks.empty()) {
+    if (dumpStream != nullptr)
+      condition.wait_until(lock, nextDump);
+    else
+      condition.wait(lock);
+    Clock::time_point now = Clock::now();
+    own.recordIdle(now - start);
+    start = now;
+    dumpDueMetrics(lock);
+  }
+}
+
+inline ThreadPool::WorkerIdentity& ThreadPool::currentWorker() {
+  static thread_local WorkerIdentity identity = {nullptr, -1};
+  return identity;
+}
+
+inline int ThreadPool::workerIndex() const {
+  WorkerIdentity const& identity = currentWorker();
+  return identity.pool == this ? identity.index : -1;
+}
+
+// lock must own queue_mutex, counters are copied under it and printed after
+// unlocking, so slow stream doesn't block enqueue and other workers
+inline void ThreadPool::dumpDueMetrics(std::unique_lock<std::mutex>& lock) {
+  if (dumpStream == nullptr || Clock::now() < nextDump) return;
+  nextDump = Clock::now() + dumpPeriod;
+  std::vector<Metrics> snapshot = metricsLocked();
+  std::ostream* out = dumpStream;
+  lock.unlock();
+  std::ostringstream text;
+  Metrics total;
+  for (size_t i = 0; i < snapshot.size(); ++i) {
+    snapshot[i].print(text, "worker " + std::to_string(i));
+    total.add(snapshot[i]);
+  }
+  total.print(text, "pool");
+  *out << text.str() << std::flush;
+  lock.lock();
+}
+
+// queue_mutex must be owned by caller
+inline std::vector<ThreadPool::Metrics> ThreadPool::metricsLocked() {
+  std::vector<Metrics> result(finished);
+  for (size_t i = 0; i < counters.size(); ++i)
+    if (counters[i] != nullptr) result[i] = counters[i]->snapshot();
+  return result;
+}
+
+inline std::vector<ThreadPool::Metrics> ThreadPool::metrics() {
+  std::unique_lock<std::mutex> lock(queue_mutex);
+  return metricsLocked();
+}
+
+inline void ThreadPool::setMetricsDump(std::ostream* out,
+                                       std::chrono::milliseconds period) {
+  // zero period would make idle workers spin instead of sleeping
+  if (out != nullptr && period <= std::chrono::milliseconds::zero())
+    throw std::invalid_argument("non-positive period of metrics dump");
+  {
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    dumpStream = out;
+    dumpPeriod = period;
+    nextDump = Clock::now() + dumpPeriod;
+  }
+  // let sleeping workers wait for the dump time
+  condition.notify_all();
+}
+
 // add new work item to the pool
 template <class F, class... Args>
 auto ThreadPool::enqueue(F&& f, Args&&... args)
@@ -68,7 +331,12 @@ auto ThreadPool::enqueue(F&& f, Args&&... args)
     // don't allow enqueueing after stopping the pool
     if (stop) throw std::runtime_error("enqueue on stopped ThreadPool");
 
-    tasks.emplace([task]() { (*task)(); });
+    Task item;
+    item.function = [task]() { (*task)(); };
+#ifdef THREADPOOL_METRICS
+    item.enqueued = Clock::now();
+#endif
+    tasks.push(std::move(item));
   }
   condition.notify_one();
   return res;